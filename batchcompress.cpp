@@ -0,0 +1,186 @@
+#include "batchcompress.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+#include "instrument.h"
+#include "outputfile.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <streambuf>
+#include <stdexcept>
+#include <thread>
+#include <filesystem>
+#include <system_error>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Output sink that compares everything written to it with expected bytes
+class MatchBuf : public std::streambuf {
+public:
+    MatchBuf(const unsigned char* expected, size_t size) : expected(expected), size(size) {}
+
+    bool matched() const { return same && pos == size; }
+
+protected:
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        size_t count = static_cast<size_t>(n);
+        if (same && (count > size - pos || std::memcmp(expected + pos, s, count) != 0)) same = false;
+        if (same) pos += count;
+        return n;
+    }
+
+    int_type overflow(int_type c) override {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        char ch = traits_type::to_char_type(c);
+        xsputn(&ch, 1);
+        return c;
+    }
+
+private:
+    const unsigned char* expected;
+    size_t size;
+    size_t pos = 0;
+    bool same = true;
+};
+
+// True if the file still has the size and mtime recorded by the scan
+bool unchanged(const FileTable& files, FileTable::Id id, const std::string& path) {
+#ifdef __linux__
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    uint64_t size = static_cast<uint64_t>(st.st_size);
+    int64_t mtimeNs = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    std::error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+    int64_t mtimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+#endif
+    return size == files.sizeOf(id) && (files.mtimeNs(id) == 0 || mtimeNs == files.mtimeNs(id));
+}
+
+} // namespace
+
+bool verifyCompressed(const std::string& compressed, const std::string& original) {
+    MappedFile source(original, MappedFile::Sequential);
+    std::ifstream in(compressed, std::ios::binary);
+    if (!source.isOpen() || !in) return false;
+    MatchBuf buf(source.data(), source.size());
+    std::ostream sink(&buf);
+    try {
+        decompressStream(in, sink);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return buf.matched();
+}
+
+namespace {
+
+void compressOne(const FileTable& files, BatchCompressResult& result, const BatchCompressOptions& options,
+                 const HuffmanOptions& huffman) {
+    instrument::TraceScope trace("compress-file", files.sizeOf(result.id));
+    std::string path = files.path(result.id);
+    std::string output = path + ".huff";
+    std::error_code ec;
+
+    if (!unchanged(files, result.id, path)) {
+        result.error = "changed since the scan";
+        return;
+    }
+    // Never replace a .huff that was already there (checked again, atomically,
+    // when the result is moved into place)
+    if (fs::exists(fs::symlink_status(output, ec))) {
+        result.error = output + " already exists";
+        return;
+    }
+    // A fresh private name: nobody else's file is truncated or removed
+    std::string temp = createTempFor(output);
+    if (temp.empty()) {
+        result.error = "cannot create a temporary file for " + output + ": " + std::strerror(errno);
+        return;
+    }
+    try {
+        result.stats = compressFile(path, temp, huffman);
+    } catch (const std::runtime_error& e) {
+        fs::remove(temp, ec);
+        result.error = e.what();
+        return;
+    }
+    if (!verifyCompressed(temp, path) || !unchanged(files, result.id, path)) {
+        fs::remove(temp, ec);
+        result.error = "verification failed";
+        return;
+    }
+    if (!copyMetadata(path, temp, result.error)) {
+        fs::remove(temp, ec);
+        return;
+    }
+
+    // Atomic: the .huff is never seen half-written
+    if (int err = publishFile(temp, output)) {
+        fs::remove(temp, ec);
+        result.error = err == EEXIST ? output + " already exists"
+                                     : "cannot rename to " + output + ": " + std::strerror(err);
+        return;
+    }
+    result.output = output;
+    if (options.replace) {
+        result.replaced = fs::remove(path, ec);
+        if (!result.replaced) result.error = "cannot remove original: " + ec.message();
+    }
+}
+
+} // namespace
+
+std::vector<BatchCompressResult> compressBatch(const FileTable& files, const std::vector<FileTable::Id>& ids,
+                                               const BatchCompressOptions& options) {
+    std::vector<BatchCompressResult> results(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) results[i].id = ids[i];
+    if (ids.empty()) return results;
+
+    // Longest processing time first: hand out jobs in order of size
+    std::vector<size_t> order(ids.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return files.sizeOf(ids[a]) > files.sizeOf(ids[b]); });
+
+    unsigned jobs = std::max(1u, std::min<unsigned>(options.jobs, static_cast<unsigned>(ids.size())));
+    unsigned threads = options.huffman.threads ? options.huffman.threads : std::thread::hardware_concurrency();
+    HuffmanOptions huffman = options.huffman;
+    huffman.threads = std::max(1u, threads / jobs);
+
+    // A bad codec or block size fails the whole batch, not every file
+    checkOptions(huffman);
+
+    // Each worker pulls the next job from a shared cursor; the pool's own
+    // queues are LIFO and would not keep the order
+    std::atomic<size_t> next{0};
+    ProgressReporter progress(options.progress, "compress", ids.size());
+    ThreadPool pool(jobs);
+    for (unsigned w = 0; w < jobs; ++w) {
+        pool.submit([&] {
+            for (size_t k = next++; k < order.size(); k = next++) {
+                try {
+                    compressOne(files, results[order[k]], options, huffman);
+                } catch (const std::exception& e) {
+                    results[order[k]].error = e.what();
+                }
+                progress.advance();
+            }
+        });
+    }
+    pool.wait();
+    return results;
+}
@@ -0,0 +1,37 @@
+#ifndef BATCHCOMPRESS_H
+#define BATCHCOMPRESS_H
+
+#include "filetable.h"
+#include "huffman.h"
+#include "progress.h"
+#include <string>
+#include <vector>
+
+struct BatchCompressOptions {
+    HuffmanOptions huffman;  // codec and block size; threads is the total across jobs
+    unsigned jobs = 4;       // files in flight at once, which also caps open files and I/O streams
+    bool replace = true;     // swap each original for its .huff once verified
+    ProgressCallback progress; // files finished (or failed) in the "compress" phase
+};
+
+struct BatchCompressResult {
+    FileTable::Id id;
+    std::string output;      // path of the .huff file ("" on failure)
+    HuffmanStats stats;
+    bool replaced = false;   // original removed
+    std::string error;       // set when the file was skipped or failed
+};
+
+// True if compressed decodes without error to exactly the bytes of original
+bool verifyCompressed(const std::string& compressed, const std::string& original);
+
+// Compress the given rows of files, largest first so the long jobs don't end
+// up last. Each output is written to a temporary name, decoded again and
+// compared with the original, and only then renamed to path + ".huff"; a
+// file whose size or mtime no longer matches the table is left alone.
+// Results come back in the order of ids. Errors are reported per file;
+// only a bad codec or block size throws (std::invalid_argument).
+std::vector<BatchCompressResult> compressBatch(const FileTable& files, const std::vector<FileTable::Id>& ids,
+                                               const BatchCompressOptions& options = BatchCompressOptions());
+
+#endif
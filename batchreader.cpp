@@ -0,0 +1,379 @@
+#include "batchreader.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BATCHREADER_HAVE_PREAD 1
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define BATCHREADER_HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef BATCHREADER_HAVE_IO_URING
+
+// Minimal io_uring driver over the raw system calls, so no liburing is
+// needed: one submission queue entry per request in flight, submitted and
+// reaped by the thread calling read()
+struct BatchReader::Ring {
+    int fd = -1;
+    unsigned entries = 0;
+    void* sqMap = MAP_FAILED;
+    void* cqMap = MAP_FAILED;
+    void* sqeMap = MAP_FAILED;
+    size_t sqMapSize = 0, cqMapSize = 0, sqeMapSize = 0;
+    unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned pending = 0; // queued but not yet submitted
+
+    ~Ring() {
+        if (sqeMap != MAP_FAILED) munmap(sqeMap, sqeMapSize);
+        if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+        if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+        if (fd >= 0) close(fd);
+    }
+
+    // False if the kernel has no io_uring, a seccomp policy blocks it, or it
+    // lacks the open/read/close operations (before 5.6)
+    bool setup(unsigned size) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, size, &p));
+        if (fd < 0) return false;
+        entries = p.sq_entries;
+
+        sqMapSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqMapSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+
+        sqMap = mmap(nullptr, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMap == MAP_FAILED) return false;
+        cqMap = single ? sqMap
+                       : mmap(nullptr, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                              IORING_OFF_CQ_RING);
+        if (cqMap == MAP_FAILED) return false;
+        sqeMapSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqeMap = mmap(nullptr, sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sqMap);
+        char* cq = static_cast<char*>(cqMap);
+        sqHead = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+        sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+        const int last = IORING_OP_CLOSE;
+        std::vector<unsigned char> buffer(sizeof(io_uring_probe) + (last + 1) * sizeof(io_uring_probe_op));
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, last + 1) < 0) return false;
+        for (int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+        }
+        return true;
+    }
+
+    // The caller keeps at most `entries` operations outstanding, so there
+    // is always room
+    void queue(const io_uring_sqe& sqe) {
+        unsigned tail = *sqTail;
+        unsigned slot = tail & *sqMask;
+        sqes[slot] = sqe;
+        sqArray[slot] = slot;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        pending++;
+    }
+
+    // Submit what is queued and wait until at least one operation completes
+    void submitAndWait() {
+        while (true) {
+            long r = syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r >= 0) {
+                pending -= std::min<unsigned>(pending, static_cast<unsigned>(r));
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    template <typename Fn>
+    void reap(Fn handle) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            io_uring_cqe cqe = cqes[head & *cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            handle(cqe.user_data, cqe.res);
+        }
+    }
+};
+
+#else
+
+struct BatchReader::Ring {};
+
+#endif
+
+BatchReader::BatchReader(unsigned depth, Engine engine, size_t memoryBudget)
+    : depth(std::max(1u, depth)), memoryBudget(memoryBudget) {
+#ifdef BATCHREADER_HAVE_IO_URING
+    if (engine == Auto) {
+        ring.reset(new Ring);
+        if (!ring->setup(this->depth) || ring->entries < this->depth) ring.reset();
+    }
+#else
+    (void)engine;
+#endif
+}
+
+BatchReader::~BatchReader() = default;
+
+const char* BatchReader::engine() const {
+    return ring ? "io_uring" : "threads";
+}
+
+void BatchReader::read(const std::vector<ReadRequest>& requests, const Handler& done) {
+    if (requests.empty()) return;
+    if (ring) readWithRing(requests, done);
+    else readWithThreads(requests, done);
+}
+
+namespace {
+
+// Blocking read of one request into buffer; returns 0 or an errno value
+int readOne(const ReadRequest& request, std::vector<unsigned char>& buffer, size_t& got) {
+    buffer.resize(request.head + request.tail);
+    got = 0;
+#ifdef BATCHREADER_HAVE_PREAD
+    int fd = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+    int error = 0;
+    auto readAt = [&](size_t want, uint64_t offset) {
+        while (want > 0) {
+            ssize_t r = pread(fd, buffer.data() + got, want, static_cast<off_t>(offset));
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0) error = errno;
+            if (r <= 0) return false;
+            got += static_cast<size_t>(r);
+            want -= static_cast<size_t>(r);
+            offset += static_cast<uint64_t>(r);
+        }
+        return true;
+    };
+    if (readAt(request.head, 0)) readAt(request.tail, request.size - request.tail);
+    close(fd);
+    return error;
+#else
+    std::ifstream in(request.path, std::ios::binary);
+    if (!in) return ENOENT;
+    in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(request.head));
+    got = static_cast<size_t>(in.gcount());
+    if (got == request.head && request.tail > 0) {
+        in.seekg(static_cast<std::streamoff>(request.size - request.tail));
+        in.read(reinterpret_cast<char*>(buffer.data() + got), static_cast<std::streamsize>(request.tail));
+        got += static_cast<size_t>(in.gcount());
+    }
+    return in.bad() ? EIO : 0;
+#endif
+}
+
+} // namespace
+
+void BatchReader::readWithThreads(const std::vector<ReadRequest>& requests, const Handler& done) {
+    // Blocking reads spend their time waiting, so run more of them than
+    // there are cores
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    unsigned threads = std::min<unsigned>({depth, std::max(8u, 2 * hardware),
+                                           static_cast<unsigned>(requests.size())});
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    ThreadPool pool(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        pool.submit([&] {
+            std::vector<unsigned char> buffer;
+            for (size_t k = next++; k < requests.size() && !failed; k = next++) {
+                size_t got = 0;
+                int error = readOne(requests[k], buffer, got);
+                try {
+                    done(k, error ? nullptr : buffer.data(), error ? 0 : got, error);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(failureMutex);
+                    if (!failure) failure = std::current_exception();
+                    failed = true;
+                }
+            }
+        });
+    }
+    pool.wait();
+    if (failure) std::rethrow_exception(failure);
+}
+
+#ifdef BATCHREADER_HAVE_IO_URING
+
+void BatchReader::readWithRing(const std::vector<ReadRequest>& requests, const Handler& done) {
+    // Each slot walks one request through open -> read head -> read tail ->
+    // close, with exactly one operation in the ring at a time
+    enum Stage { Open, ReadHead, ReadTail, Close };
+    struct Slot {
+        size_t index = 0;
+        Stage stage = Open;
+        int fd = -1;
+        size_t filled = 0;
+        std::vector<unsigned char> buffer;
+    };
+    std::vector<Slot> slots(depth);
+    std::vector<unsigned> idle;
+    for (unsigned s = depth; s-- > 0;) idle.push_back(s);
+
+    Ring& r = *ring;
+    size_t next = 0, inFlightBytes = 0;
+    std::exception_ptr failure;
+
+    auto makeSqe = [&](unsigned s, uint8_t opcode, int fd) {
+        io_uring_sqe sqe;
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = opcode;
+        sqe.fd = fd;
+        sqe.user_data = s;
+        return sqe;
+    };
+    auto queueClose = [&](unsigned s) {
+        slots[s].stage = Close;
+        r.queue(makeSqe(s, IORING_OP_CLOSE, slots[s].fd));
+    };
+    auto deliver = [&](unsigned s, int error) {
+        Slot& slot = slots[s];
+        if (failure) return; // stop calling a handler that threw, only drain
+        try {
+            done(slot.index, error ? nullptr : slot.buffer.data(), error ? 0 : slot.filled, error);
+        } catch (...) {
+            failure = std::current_exception();
+        }
+    };
+    auto release = [&](unsigned s) {
+        inFlightBytes -= slots[s].buffer.size();
+        idle.push_back(s);
+    };
+    // Queue the next read of a slot, or finish it once head and tail are in
+    auto advance = [&](unsigned s) {
+        Slot& slot = slots[s];
+        const ReadRequest& request = requests[slot.index];
+        size_t want = 0;
+        uint64_t offset = 0;
+        if (slot.filled < request.head) {
+            slot.stage = ReadHead;
+            want = request.head - slot.filled;
+            offset = slot.filled;
+        } else if (slot.filled < request.head + request.tail) {
+            slot.stage = ReadTail;
+            want = request.head + request.tail - slot.filled;
+            offset = request.size - request.tail + (slot.filled - request.head);
+        } else {
+            deliver(s, 0);
+            queueClose(s);
+            return;
+        }
+        io_uring_sqe sqe = makeSqe(s, IORING_OP_READ, slot.fd);
+        sqe.addr = reinterpret_cast<uintptr_t>(slot.buffer.data() + slot.filled);
+        sqe.len = static_cast<uint32_t>(std::min<size_t>(want, 1u << 30));
+        sqe.off = offset;
+        r.queue(sqe);
+    };
+
+    while (true) {
+        // Fill free slots while the memory budget allows; a request larger
+        // than the whole budget runs when nothing else is in flight
+        while (!failure && next < requests.size() && !idle.empty()) {
+            const ReadRequest& request = requests[next];
+            size_t need = request.head + request.tail;
+            if (idle.size() < depth && inFlightBytes + need > memoryBudget) break;
+
+            unsigned s = idle.back();
+            idle.pop_back();
+            Slot& slot = slots[s];
+            slot.index = next++;
+            slot.stage = Open;
+            slot.fd = -1;
+            slot.filled = 0;
+            slot.buffer.resize(need);
+            inFlightBytes += need;
+
+            io_uring_sqe sqe = makeSqe(s, IORING_OP_OPENAT, AT_FDCWD);
+            sqe.addr = reinterpret_cast<uintptr_t>(request.path.c_str());
+            sqe.open_flags = O_RDONLY | O_CLOEXEC;
+            r.queue(sqe);
+        }
+        if (idle.size() == depth) break;
+
+        r.submitAndWait();
+        r.reap([&](uint64_t userData, int res) {
+            unsigned s = static_cast<unsigned>(userData);
+            Slot& slot = slots[s];
+            switch (slot.stage) {
+            case Open:
+                if (res < 0) {
+                    deliver(s, -res);
+                    release(s);
+                } else {
+                    slot.fd = res;
+                    advance(s);
+                }
+                break;
+            case ReadHead:
+            case ReadTail:
+                if (res < 0) {
+                    deliver(s, -res);
+                    queueClose(s);
+                } else if (res == 0) {
+                    // End of file: the file shrank since it was listed
+                    deliver(s, 0);
+                    queueClose(s);
+                } else {
+                    slot.filled += static_cast<size_t>(res);
+                    advance(s);
+                }
+                break;
+            case Close:
+                release(s);
+                break;
+            }
+        });
+    }
+    if (failure) std::rethrow_exception(failure);
+}
+
+#else
+
+void BatchReader::readWithRing(const std::vector<ReadRequest>& requests, const Handler& done) {
+    readWithThreads(requests, done);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef BATCHREADER_H
+#define BATCHREADER_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// One file to read: its first head bytes followed by its last tail bytes,
+// delivered as one buffer. For a whole file, head = size and tail = 0.
+struct ReadRequest {
+    std::string path;
+    uint64_t size = 0;  // size the file is expected to have
+    size_t head = 0;
+    size_t tail = 0;    // must not overlap head: head + tail <= size
+};
+
+// Reads many small files with hundreds of requests in flight, for work
+// that is bound by per-file open/read/close latency rather than bandwidth.
+// On Linux it drives an io_uring (open, read, close as queued operations,
+// one system call per batch of completions); where io_uring is missing or
+// disallowed it falls back to a pool of threads doing blocking reads.
+// Whole-file mmap (MappedFile) stays the better choice for large files.
+class BatchReader {
+public:
+    enum Engine { Auto, Threads };
+
+    // depth: requests in flight at once; memoryBudget caps the bytes they
+    // hold (one request larger than the budget still runs, alone)
+    explicit BatchReader(unsigned depth = 256, Engine engine = Auto, size_t memoryBudget = 64 * 1024 * 1024);
+    ~BatchReader();
+
+    BatchReader(const BatchReader&) = delete;
+    BatchReader& operator=(const BatchReader&) = delete;
+
+    // "io_uring" or "threads"
+    const char* engine() const;
+
+    // Called once per request, in completion order. data is valid only
+    // during the call; size is short if the file shrank. error is an errno
+    // value (0 on success), in which case data is null. With the thread
+    // engine calls come from several threads at once, each for a different
+    // index, so the handler must not share unguarded state between indices.
+    using Handler = std::function<void(size_t index, const unsigned char* data, size_t size, int error)>;
+
+    // Read every request and return when all have been handled. Exceptions
+    // thrown by the handler are rethrown here after the reads in flight end.
+    void read(const std::vector<ReadRequest>& requests, const Handler& done);
+
+private:
+    struct Ring;
+
+    unsigned depth;
+    size_t memoryBudget;
+    std::unique_ptr<Ring> ring; // null with the thread engine
+
+    void readWithThreads(const std::vector<ReadRequest>& requests, const Handler& done);
+    void readWithRing(const std::vector<ReadRequest>& requests, const Handler& done);
+};
+
+#endif
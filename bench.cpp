@@ -0,0 +1,465 @@
+// storage_bench: microbenchmarks for the hot paths, on synthetic corpora
+// generated from a fixed seed so runs are comparable.
+//
+//   storage_bench [--filter TEXT] [--min-time SECONDS] [--size MB] [--csv]
+//
+// Each benchmark repeats until it has run for --min-time and reports time
+// per iteration, throughput, heap allocations per iteration and the peak
+// RSS reached while it ran.
+#include "scanner.h"
+#include "scanindex.h"
+#include "duplicates.h"
+#include "optimizer.h"
+#include "huffman.h"
+#include "hasher.h"
+#include "histogram.h"
+#include "entropy.h"
+#include "codec.h"
+#include "mappedfile.h"
+#include "batchreader.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Every allocation in the process goes through these, so the counter covers
+// the standard library and the worker threads too
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct Settings {
+    std::string filter;
+    double minTime = 0.5;
+    size_t corpusBytes = 16 << 20;
+    bool csv = false;
+};
+
+// Linux: reset the peak RSS counter so each benchmark reports its own peak
+void resetPeakRss() {
+    std::ofstream("/proc/self/clear_refs") << "5";
+}
+
+uint64_t peakRssKB() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+    return 0;
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations = 0;
+    double secondsPerIteration = 0.0;
+    uint64_t bytesPerIteration = 0;
+    uint64_t allocationsPerIteration = 0;
+    uint64_t peakRssKB = 0;
+};
+
+class Runner {
+public:
+    explicit Runner(const Settings& settings) : settings(settings) {
+        if (settings.csv) std::cout << "name,iterations,ns_per_iter,mb_per_s,allocs_per_iter,peak_rss_kb\n";
+        else std::printf("%-36s %10s %14s %12s %12s %12s\n", "benchmark", "iters", "time/iter", "MB/s",
+                         "allocs/iter", "peak RSS");
+    }
+
+    bool selected(const std::string& name) const { return name.find(settings.filter) != std::string::npos; }
+
+    // fn runs one iteration and processes `bytes` bytes (0 = no throughput)
+    void run(const std::string& name, uint64_t bytes, const std::function<void()>& fn) {
+        if (!selected(name)) return;
+
+        fn(); // warm up caches and lazily built tables
+        resetPeakRss();
+        uint64_t allocsBefore = allocations.load();
+        auto start = std::chrono::steady_clock::now();
+        uint64_t iterations = 0;
+        double elapsed = 0.0;
+        do {
+            fn();
+            ++iterations;
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < settings.minTime);
+
+        Result r;
+        r.name = name;
+        r.iterations = iterations;
+        r.secondsPerIteration = elapsed / iterations;
+        r.bytesPerIteration = bytes;
+        r.allocationsPerIteration = (allocations.load() - allocsBefore) / iterations;
+        r.peakRssKB = peakRssKB();
+        print(r);
+    }
+
+private:
+    const Settings& settings;
+
+    void print(const Result& r) const {
+        double mbps = r.bytesPerIteration ? r.bytesPerIteration / r.secondsPerIteration / (1024.0 * 1024.0) : 0.0;
+        if (settings.csv) {
+            std::cout << r.name << "," << r.iterations << "," << static_cast<uint64_t>(r.secondsPerIteration * 1e9)
+                      << "," << mbps << "," << r.allocationsPerIteration << "," << r.peakRssKB << "\n";
+            return;
+        }
+        char time[32];
+        if (r.secondsPerIteration >= 1.0) std::snprintf(time, sizeof(time), "%.3f s", r.secondsPerIteration);
+        else if (r.secondsPerIteration >= 1e-3) std::snprintf(time, sizeof(time), "%.3f ms", r.secondsPerIteration * 1e3);
+        else std::snprintf(time, sizeof(time), "%.3f us", r.secondsPerIteration * 1e6);
+        std::printf("%-36s %10llu %14s %12.1f %12llu %9llu KB\n", r.name.c_str(),
+                    static_cast<unsigned long long>(r.iterations), time, mbps,
+                    static_cast<unsigned long long>(r.allocationsPerIteration),
+                    static_cast<unsigned long long>(r.peakRssKB));
+        std::fflush(stdout);
+    }
+};
+
+// --- corpora ---------------------------------------------------------------
+
+std::vector<unsigned char> randomCorpus(size_t size, std::mt19937_64& rng) {
+    std::vector<unsigned char> data(size);
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        uint64_t v = rng();
+        std::memcpy(&data[i], &v, 8);
+    }
+    for (size_t i = size & ~size_t(7); i < size; ++i) data[i] = static_cast<unsigned char>(rng());
+    return data;
+}
+
+// Words drawn with a skewed (roughly Zipfian) distribution, like prose
+std::vector<unsigned char> textCorpus(size_t size, std::mt19937_64& rng) {
+    std::vector<std::string> words;
+    std::uniform_int_distribution<int> length(2, 10), letter('a', 'z');
+    for (int i = 0; i < 2000; ++i) {
+        std::string w;
+        for (int n = length(rng); n > 0; --n) w += static_cast<char>(letter(rng));
+        words.push_back(w);
+    }
+    std::vector<double> weights;
+    for (size_t i = 0; i < words.size(); ++i) weights.push_back(1.0 / (i + 1));
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+
+    std::vector<unsigned char> data;
+    data.reserve(size);
+    size_t sentence = 0;
+    while (data.size() < size) {
+        const std::string& w = words[pick(rng)];
+        data.insert(data.end(), w.begin(), w.end());
+        data.push_back(++sentence % 12 == 0 ? '\n' : ' ');
+    }
+    data.resize(size);
+    return data;
+}
+
+// Timestamped lines from a few hundred templates, like an access log
+std::vector<unsigned char> logCorpus(size_t size, std::mt19937_64& rng) {
+    const char* levels[] = {"INFO", "INFO", "INFO", "WARN", "DEBUG", "ERROR"};
+    const char* verbs[] = {"GET", "POST", "PUT", "DELETE"};
+    std::vector<std::string> templates;
+    for (int i = 0; i < 300; ++i) {
+        templates.push_back(std::string(verbs[rng() % 4]) + " /api/v" + std::to_string(rng() % 3 + 1) + "/" +
+                            (i % 2 ? "users/" : "orders/") + std::to_string(rng() % 1000));
+    }
+
+    std::vector<unsigned char> data;
+    data.reserve(size);
+    char line[256];
+    for (uint64_t t = 0; data.size() < size; ++t) {
+        int n = std::snprintf(line, sizeof(line), "2026-10-16T%02llu:%02llu:%02llu.%03llu %s %s %llu %llums\n",
+                              static_cast<unsigned long long>(t / 360000 % 24),
+                              static_cast<unsigned long long>(t / 6000 % 60),
+                              static_cast<unsigned long long>(t / 100 % 60),
+                              static_cast<unsigned long long>(t * 10 % 1000), levels[rng() % 6],
+                              templates[rng() % templates.size()].c_str(),
+                              static_cast<unsigned long long>(rng() % 5 ? 200 : 404),
+                              static_cast<unsigned long long>(rng() % 900 + 1));
+        data.insert(data.end(), line, line + n);
+    }
+    data.resize(size);
+    return data;
+}
+
+void writeFile(const std::string& path, const unsigned char* data, size_t size) {
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+// A tree of many small files, a tenth of them copies of another, in nested
+// directories
+void smallFileTree(const std::string& root, size_t files, std::mt19937_64& rng) {
+    std::vector<std::vector<unsigned char>> originals;
+    for (size_t i = 0; i < files; ++i) {
+        std::string dir = root + "/d" + std::to_string(i % 40) + "/s" + std::to_string(i % 7);
+        fs::create_directories(dir);
+        std::string path = dir + "/f" + std::to_string(i) + (i % 3 ? ".log" : ".bin");
+        if (!originals.empty() && rng() % 10 == 0) {
+            const auto& copy = originals[rng() % originals.size()];
+            writeFile(path, copy.data(), copy.size());
+            continue;
+        }
+        std::vector<unsigned char> data = i % 3 ? logCorpus(rng() % 8192 + 1, rng) : randomCorpus(rng() % 8192 + 1, rng);
+        writeFile(path, data.data(), data.size());
+        if (originals.size() < 256) originals.push_back(std::move(data));
+    }
+}
+
+struct Corpus {
+    std::string name;
+    std::vector<unsigned char> data;
+    std::string path; // the same bytes on disk
+};
+
+// --- benchmarks ------------------------------------------------------------
+
+void benchHashes(Runner& runner, const std::vector<Corpus>& corpora) {
+    for (const std::string& name : hasherNames()) {
+        auto hasher = makeHasher(name);
+        for (const Corpus& c : corpora) {
+            runner.run("hash/" + name + "/" + c.name, c.data.size(),
+                       [&] { hasher->hash(c.data.data(), c.data.size()); });
+        }
+    }
+}
+
+void benchHistogram(Runner& runner, const std::vector<Corpus>& corpora) {
+    for (const Corpus& c : corpora) {
+        runner.run("histogram/" + c.name, c.data.size(), [&] {
+            uint64_t freq[256] = {};
+            byteHistogram(c.data.data(), c.data.size(), freq);
+        });
+        runner.run("estimate/" + c.name, c.data.size(), [&] { estimateCompression(c.data.data(), c.data.size()); });
+    }
+}
+
+void benchCodecs(Runner& runner, const std::vector<Corpus>& corpora, const std::string& work) {
+    for (const std::string& codec : codecNames()) {
+        HuffmanOptions options;
+        options.codec = codec;
+        for (const Corpus& c : corpora) {
+            std::string packed = work + "/" + c.name + "." + codec + ".huff";
+            std::string unpacked = work + "/" + c.name + "." + codec + ".out";
+            runner.run("compress/" + codec + "/" + c.name, c.data.size(),
+                       [&] { compressFile(c.path, packed, options); });
+            runner.run("decompress/" + codec + "/" + c.name, c.data.size(),
+                       [&] { decompressFile(packed, unpacked); });
+        }
+
+        // Scaling with encoder threads, on the text corpus
+        const Corpus& text = corpora[1];
+        std::string packed = work + "/threads." + codec + ".huff";
+        unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> counts;
+        for (unsigned t = 1; t < hw; t *= 2) counts.push_back(t);
+        counts.push_back(hw);
+        for (unsigned t : counts) {
+            options.threads = t;
+            runner.run("compress/" + codec + "/threads:" + std::to_string(t), text.data.size(),
+                       [&] { compressFile(text.path, packed, options); });
+        }
+    }
+}
+
+// Reference decoder for decode/table: one bit at a time down a tree of the
+// canonical codes, as huffman.cpp decoded before its lookup table. The table
+// is the dense or pair form huffmanEncode writes.
+void treeWalkDecode(const unsigned char* table, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                    unsigned char* out, size_t rawSize) {
+    uint8_t lengths[256] = {};
+    if (tableSize == 256) std::copy(table, table + 256, lengths);
+    else for (size_t i = 0; i + 1 < tableSize; i += 2) lengths[table[i]] = table[i + 1];
+    HuffCode codes[256];
+    buildCanonicalCodes(lengths, codes);
+
+    struct Node {
+        int child[2] = {-1, -1};
+        int symbol = -1;
+    };
+    std::vector<Node> nodes(1);
+    for (int s = 0; s < 256; ++s) {
+        int n = 0;
+        for (int bit = codes[s].length - 1; bit >= 0; --bit) {
+            int b = (codes[s].bits >> bit) & 1;
+            if (nodes[n].child[b] < 0) {
+                nodes[n].child[b] = static_cast<int>(nodes.size());
+                nodes.emplace_back();
+            }
+            n = nodes[n].child[b];
+        }
+        if (codes[s].length) nodes[n].symbol = s;
+    }
+
+    size_t decoded = 0;
+    int n = 0;
+    for (size_t i = 0; i < payloadSize && decoded < rawSize; ++i) {
+        for (int bit = 7; bit >= 0 && decoded < rawSize; --bit) {
+            n = nodes[n].child[(payload[i] >> bit) & 1];
+            if (nodes[n].symbol >= 0) {
+                out[decoded++] = static_cast<unsigned char>(nodes[n].symbol);
+                n = 0;
+            }
+        }
+    }
+}
+
+void benchDecoders(Runner& runner, const std::vector<Corpus>& corpora) {
+    for (const Corpus& c : corpora) {
+        std::vector<unsigned char> encoded;
+        size_t tableSize = huffmanEncode(c.data.data(), c.data.size(), encoded);
+        const unsigned char* payload = encoded.data() + tableSize;
+        size_t payloadSize = encoded.size() - tableSize;
+        std::vector<unsigned char> decoded(c.data.size());
+        auto check = [&](const std::string& name) {
+            if (runner.selected(name) && decoded != c.data) std::cerr << name << ": output differs from the input\n";
+            std::fill(decoded.begin(), decoded.end(), 0);
+        };
+        std::string name = "decode/tree-walk/" + c.name;
+        runner.run(name, c.data.size(), [&] {
+            treeWalkDecode(encoded.data(), tableSize, payload, payloadSize, decoded.data(), decoded.size());
+        });
+        check(name);
+        name = "decode/table/" + c.name;
+        runner.run(name, c.data.size(), [&] {
+            decodeBlock(encoded.data(), tableSize, payload, payloadSize, decoded.data(), decoded.size());
+        });
+        check(name);
+    }
+}
+
+void benchTree(Runner& runner, const std::string& tree, const std::string& work) {
+    uint64_t bytes = 0;
+    for (auto f : scanDirectory(tree).files) bytes += f.size();
+
+    runner.run("scan/full", bytes, [&] { scanDirectory(tree); });
+
+    // Incremental rescan against an index of the unchanged tree. The tree
+    // was just written, and directories modified within a second of the
+    // index are never trusted, so their mtimes are moved back a minute first.
+    struct timespec minuteAgo[2];
+    clock_gettime(CLOCK_REALTIME, &minuteAgo[0]);
+    minuteAgo[0].tv_sec -= 60;
+    minuteAgo[1] = minuteAgo[0];
+    utimensat(AT_FDCWD, tree.c_str(), minuteAgo, 0);
+    for (const auto& entry : fs::recursive_directory_iterator(tree)) {
+        if (entry.is_directory()) utimensat(AT_FDCWD, entry.path().c_str(), minuteAgo, 0);
+    }
+    std::string indexPath = work + "/tree.index";
+    ScanIndex::save(indexPath, scanDirectory(tree), "xxh64", "blake3");
+    ScanIndex index;
+    index.load(indexPath, "xxh64", "blake3");
+    runner.run("scan/indexed", bytes, [&] { scanDirectory(tree, 0, &index); });
+    if (runner.selected("scan/indexed")) {
+        ScanResult rescan = scanDirectory(tree, 0, &index);
+        std::cerr << "scan/indexed: " << rescan.directoriesReused << " of " << rescan.files.directoryCount()
+                  << " directories reused\n";
+    }
+
+    // Reading every file whole: one mapping per file against batched reads
+    ScanResult listed = scanDirectory(tree);
+    std::vector<ReadRequest> requests;
+    for (auto f : listed.files) {
+        ReadRequest request;
+        request.path = f.path();
+        request.size = request.head = f.size();
+        requests.push_back(std::move(request));
+    }
+    runner.run("read/mmap", bytes, [&] {
+        volatile unsigned char sink = 0;
+        for (const ReadRequest& r : requests) {
+            MappedFile file(r.path, MappedFile::Sequential);
+            for (size_t i = 0; i < file.size(); i += 4096) sink = sink + file.data()[i]; // fault every page in
+        }
+    });
+    for (BatchReader::Engine engine : {BatchReader::Auto, BatchReader::Threads}) {
+        BatchReader reader(256, engine);
+        runner.run(std::string("read/") + reader.engine(), bytes,
+                   [&] { reader.read(requests, [](size_t, const unsigned char*, size_t, int) {}); });
+    }
+
+    runner.run("duplicates/tree", bytes, [&] {
+        ScanResult scan = scanDirectory(tree);
+        findDuplicates(scan.files);
+    });
+
+    ScanResult scan = scanDirectory(tree);
+    optimizer generous(1e9), tight(bytes / (1024.0 * 1024.0) / 4);
+    runner.run("rank/all-fit", bytes, [&] { generous.rankFilesKnapsack(scan.files); });
+    runner.run("rank/quarter", bytes, [&] { tight.rankFilesKnapsack(scan.files); });
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--csv") settings.csv = true;
+        else if (arg == "--filter" && i + 1 < argc) settings.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc) settings.minTime = std::atof(argv[++i]);
+        else if (arg == "--size" && i + 1 < argc) settings.corpusBytes = std::strtoull(argv[++i], nullptr, 10) << 20;
+        else {
+            std::cerr << "usage: storage_bench [--filter TEXT] [--min-time SECONDS] [--size MB] [--csv]\n";
+            return 2;
+        }
+    }
+
+    std::string work = (fs::temp_directory_path() / ("storage_bench-" + std::to_string(getpid()))).string();
+    fs::create_directories(work);
+
+    std::mt19937_64 rng(20261016);
+    std::vector<Corpus> corpora;
+    corpora.push_back({"random", randomCorpus(settings.corpusBytes, rng), ""});
+    corpora.push_back({"text", textCorpus(settings.corpusBytes, rng), ""});
+    corpora.push_back({"log", logCorpus(settings.corpusBytes, rng), ""});
+    for (Corpus& c : corpora) {
+        c.path = work + "/" + c.name + ".dat";
+        writeFile(c.path, c.data.data(), c.data.size());
+    }
+    std::string tree = work + "/tree";
+    smallFileTree(tree, 20000, rng);
+
+    Runner runner(settings);
+    benchHashes(runner, corpora);
+    benchHistogram(runner, corpora);
+    benchCodecs(runner, corpora, work);
+    benchDecoders(runner, corpora);
+    benchTree(runner, tree, work);
+
+    std::error_code ec;
+    fs::remove_all(work, ec);
+    return 0;
+}
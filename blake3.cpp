@@ -0,0 +1,179 @@
+#include "blake3.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const uint32_t IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                        0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+const uint8_t PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+const uint32_t CHUNK_START = 1 << 0;
+const uint32_t CHUNK_END = 1 << 1;
+const uint32_t PARENT = 1 << 2;
+const uint32_t ROOT = 1 << 3;
+
+const size_t BLOCK_LEN = 64;
+const size_t CHUNK_LEN = 1024;
+
+// Inputs below this are hashed on the calling thread only
+const size_t PARALLEL_MIN_BYTES = 1 << 20;
+
+inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+inline void g(uint32_t* s, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    s[a] = s[a] + s[b] + x;
+    s[d] = rotr(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + y;
+    s[d] = rotr(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr(s[b] ^ s[c], 7);
+}
+
+// Full 16-word compression output
+void compress(const uint32_t cv[8], const uint32_t block[16], uint64_t counter, uint32_t blockLen, uint32_t flags,
+              uint32_t out[16]) {
+    uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                      IV[0], IV[1], IV[2], IV[3],
+                      static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), blockLen, flags};
+    uint32_t m[16];
+    std::memcpy(m, block, sizeof(m));
+
+    for (int round = 0; round < 7; ++round) {
+        g(s, 0, 4, 8, 12, m[0], m[1]);
+        g(s, 1, 5, 9, 13, m[2], m[3]);
+        g(s, 2, 6, 10, 14, m[4], m[5]);
+        g(s, 3, 7, 11, 15, m[6], m[7]);
+        g(s, 0, 5, 10, 15, m[8], m[9]);
+        g(s, 1, 6, 11, 12, m[10], m[11]);
+        g(s, 2, 7, 8, 13, m[12], m[13]);
+        g(s, 3, 4, 9, 14, m[14], m[15]);
+        if (round < 6) {
+            uint32_t p[16];
+            for (int i = 0; i < 16; ++i) p[i] = m[PERMUTATION[i]];
+            std::memcpy(m, p, sizeof(m));
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+    }
+}
+
+void loadBlock(const unsigned char* p, size_t len, uint32_t block[16]) {
+    unsigned char bytes[BLOCK_LEN] = {};
+    std::memcpy(bytes, p, len);
+    for (int i = 0; i < 16; ++i) {
+        block[i] = uint32_t(bytes[4 * i]) | uint32_t(bytes[4 * i + 1]) << 8 |
+                   uint32_t(bytes[4 * i + 2]) << 16 | uint32_t(bytes[4 * i + 3]) << 24;
+    }
+}
+
+// Inputs to the last compression of a node, kept so the root flag can be added
+struct Output {
+    uint32_t cv[8];
+    uint32_t block[16];
+    uint64_t counter;
+    uint32_t blockLen;
+    uint32_t flags;
+
+    void chainingValue(uint32_t out[8]) const {
+        uint32_t full[16];
+        compress(cv, block, counter, blockLen, flags, full);
+        std::memcpy(out, full, 8 * sizeof(uint32_t));
+    }
+};
+
+Output chunkOutput(const unsigned char* data, size_t len, uint64_t chunkIndex) {
+    uint32_t cv[8];
+    std::memcpy(cv, IV, sizeof(cv));
+
+    size_t blocks = len == 0 ? 1 : (len + BLOCK_LEN - 1) / BLOCK_LEN;
+    uint32_t block[16];
+    for (size_t b = 0; b + 1 < blocks; ++b) {
+        loadBlock(data + b * BLOCK_LEN, BLOCK_LEN, block);
+        uint32_t full[16];
+        compress(cv, block, chunkIndex, BLOCK_LEN, b == 0 ? CHUNK_START : 0, full);
+        std::memcpy(cv, full, sizeof(cv));
+    }
+
+    Output o;
+    size_t lastLen = len - (blocks - 1) * BLOCK_LEN;
+    std::memcpy(o.cv, cv, sizeof(cv));
+    loadBlock(data + (blocks - 1) * BLOCK_LEN, lastLen, o.block);
+    o.counter = chunkIndex;
+    o.blockLen = static_cast<uint32_t>(lastLen);
+    o.flags = (blocks == 1 ? CHUNK_START : 0) | CHUNK_END;
+    return o;
+}
+
+Output parentOutput(const uint32_t left[8], const uint32_t right[8]) {
+    Output o;
+    std::memcpy(o.cv, IV, sizeof(o.cv));
+    std::memcpy(o.block, left, 8 * sizeof(uint32_t));
+    std::memcpy(o.block + 8, right, 8 * sizeof(uint32_t));
+    o.counter = 0;
+    o.blockLen = BLOCK_LEN;
+    o.flags = PARENT;
+    return o;
+}
+
+} // namespace
+
+void blake3Hash(const unsigned char* data, size_t size, unsigned char out[BLAKE3_OUT_LEN], unsigned threads) {
+    size_t chunks = size == 0 ? 1 : (size + CHUNK_LEN - 1) / CHUNK_LEN;
+
+    // Chaining values of every chunk except the last; they don't depend on
+    // each other, so large inputs are split across threads.
+    std::vector<uint32_t> cvs((chunks - 1) * 8);
+    auto hashChunks = [&](size_t from, size_t to) {
+        for (size_t c = from; c < to; ++c) {
+            chunkOutput(data + c * CHUNK_LEN, CHUNK_LEN, c).chainingValue(&cvs[c * 8]);
+        }
+    };
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, size / PARALLEL_MIN_BYTES + 1));
+    if (threads <= 1) {
+        hashChunks(0, chunks - 1);
+    } else {
+        std::vector<std::thread> workers;
+        size_t per = (chunks - 1 + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t from = std::min(chunks - 1, t * per);
+            size_t to = std::min(chunks - 1, from + per);
+            workers.emplace_back(hashChunks, from, to);
+        }
+        for (auto& w : workers) w.join();
+    }
+
+    // Merge into the tree: after chunk i, pop one subtree per trailing zero
+    // bit of the number of chunks completed so far.
+    std::vector<uint32_t> stack;
+    for (size_t c = 0; c + 1 < chunks; ++c) {
+        uint32_t cv[8];
+        std::memcpy(cv, &cvs[c * 8], sizeof(cv));
+        for (uint64_t total = c + 1; (total & 1) == 0; total >>= 1) {
+            parentOutput(&stack[stack.size() - 8], cv).chainingValue(cv);
+            stack.resize(stack.size() - 8);
+        }
+        stack.insert(stack.end(), cv, cv + 8);
+    }
+
+    size_t lastStart = (chunks - 1) * CHUNK_LEN;
+    Output o = chunkOutput(data + lastStart, size - lastStart, chunks - 1);
+    while (!stack.empty()) {
+        uint32_t cv[8];
+        o.chainingValue(cv);
+        o = parentOutput(&stack[stack.size() - 8], cv);
+        stack.resize(stack.size() - 8);
+    }
+
+    uint32_t words[16];
+    compress(o.cv, o.block, o.counter, o.blockLen, o.flags | ROOT, words);
+    for (size_t i = 0; i < BLAKE3_OUT_LEN; ++i) out[i] = static_cast<unsigned char>(words[i / 4] >> (8 * (i % 4)));
+}
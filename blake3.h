@@ -0,0 +1,14 @@
+#ifndef BLAKE3_H
+#define BLAKE3_H
+
+#include <cstddef>
+#include <cstdint>
+
+const size_t BLAKE3_OUT_LEN = 32;
+
+// Default-mode BLAKE3 of a buffer. Chunk chaining values are computed on up
+// to `threads` threads (0 = one per core) for large inputs and then merged
+// into the tree, so the result is the same for any thread count.
+void blake3Hash(const unsigned char* data, size_t size, unsigned char out[BLAKE3_OUT_LEN], unsigned threads = 0);
+
+#endif
@@ -0,0 +1,740 @@
+#include "cli.h"
+#include "scanner.h"
+#include "scanindex.h"
+#include "duplicates.h"
+#include "optimizer.h"
+#include "huffman.h"
+#include "batchcompress.h"
+#include "outputfile.h"
+#include "instrument.h"
+#include "summary.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <filesystem>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const USAGE =
+    "usage: storage_optimizer <command> --path <path> [options]\n"
+    "\n"
+    "commands:\n"
+    "  scan        list every file under --path\n"
+    "  dedupe      find duplicate files        --policy report|delete|hardlink|reflink\n"
+    "  rank        knapsack ranking of files   --policy report|compress  [--capacity MB]\n"
+    "  compress    Huffman-compress a file or every compressible file in a directory\n"
+    "                                          --policy keep|replace   [--block-size BYTES]\n"
+    "                                          [--codec huffman|lz77|rle|store|auto]\n"
+    "  decompress  restore a .huff file or every .huff file in a directory\n"
+    "                                          --policy keep|replace   [--output FILE]\n"
+    "\n"
+    "  For compress and decompress, --path - reads stdin and --output - writes\n"
+    "  stdout (the default when reading stdin); the report then goes to stderr.\n"
+    "  An output file that already exists is left alone unless --force is given.\n"
+    "\n"
+    "options:\n"
+    "  --format json|csv      output format (default json); CSV prints rows only\n"
+    "                         and the totals line goes to stderr\n"
+    "  --threads N            worker threads, 0 = one per core (default 0)\n"
+    "  --jobs N               files compressed at once by directory compress and\n"
+    "                         rank --policy compress (default 4)\n"
+    "  --fast-hash NAME       duplicate grouping hash (default xxh64)\n"
+    "  --strong-hash NAME     duplicate confirmation hash, \"none\" to skip (default blake3)\n"
+    "  --no-index             neither read nor update the scan index\n"
+    "  --force                let compress/decompress replace existing output files\n"
+    "  --profile              print wall/CPU time, bytes and MB/s per phase to stderr\n"
+    "  --trace FILE           write a Chrome trace-event JSON file of the run\n"
+    "  --watch <dir>          (instead of a command) follow a directory live\n";
+
+// Thrown for bad command lines; reported with the usage text and exit code 2
+struct UsageError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+struct Options {
+    std::string command;
+    std::string path;
+    std::string policy;
+    std::string format = "json";
+    std::string output;
+    unsigned threads = 0;
+    double capacityMB = 0.0;
+    uint32_t blockSize = HuffmanOptions().blockSize;
+    std::string codec = HuffmanOptions().codec;
+    unsigned jobs = BatchCompressOptions().jobs;
+    bool useIndex = true;
+    bool profile = false;
+    bool force = false;
+    std::string trace;
+    DuplicateOptions hashes;
+};
+
+unsigned long long parseNumber(const std::string& option, const std::string& text) {
+    try {
+        size_t used = 0;
+        unsigned long long value = std::stoull(text, &used);
+        if (used == text.size() && text[0] != '-') return value;
+    } catch (const std::exception&) {
+    }
+    throw UsageError(option + " expects a non-negative integer, got '" + text + "'");
+}
+
+Options parseOptions(int argc, char* argv[]) {
+    Options opts;
+    opts.command = argv[1];
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--no-index") {
+            opts.useIndex = false;
+            continue;
+        }
+        if (arg == "--profile") {
+            opts.profile = true;
+            continue;
+        }
+        if (arg == "--force") {
+            opts.force = true;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) throw UsageError("unexpected argument '" + arg + "'");
+        if (i + 1 >= argc) throw UsageError(arg + " needs a value");
+        std::string value = argv[++i];
+
+        if (arg == "--path") opts.path = value;
+        else if (arg == "--policy") opts.policy = value;
+        else if (arg == "--format") opts.format = value;
+        else if (arg == "--output") opts.output = value;
+        else if (arg == "--threads") opts.threads = static_cast<unsigned>(parseNumber(arg, value));
+        else if (arg == "--capacity") opts.capacityMB = static_cast<double>(parseNumber(arg, value));
+        else if (arg == "--block-size") {
+            unsigned long long blockSize = parseNumber(arg, value);
+            if (blockSize > UINT32_MAX) throw UsageError("--block-size " + value + " is out of range");
+            opts.blockSize = static_cast<uint32_t>(blockSize);
+        }
+        else if (arg == "--codec") opts.codec = value;
+        else if (arg == "--trace") opts.trace = value;
+        else if (arg == "--jobs") opts.jobs = static_cast<unsigned>(parseNumber(arg, value));
+        else if (arg == "--fast-hash") opts.hashes.fastHash = value;
+        else if (arg == "--strong-hash") opts.hashes.strongHash = (value == "none" ? "" : value);
+        else throw UsageError("unknown option " + arg);
+    }
+
+    if (opts.path.empty()) throw UsageError("--path is required");
+    if (opts.format != "json" && opts.format != "csv") throw UsageError("--format must be json or csv");
+    return opts;
+}
+
+// The first allowed policy is the default
+void requirePolicy(Options& opts, const std::vector<std::string>& allowed) {
+    if (opts.policy.empty()) opts.policy = allowed.front();
+    std::string list;
+    for (const auto& p : allowed) {
+        if (p == opts.policy) return;
+        list += (list.empty() ? "" : "|") + p;
+    }
+    throw UsageError(opts.command + " --policy must be one of " + list);
+}
+
+std::string jsonString(const std::string& s) {
+    std::ostringstream out;
+    out << '"';
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"': out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n"; break;
+        case '\r': out << "\\r"; break;
+        case '\t': out << "\\t"; break;
+        default:
+            if (c < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+std::string csvField(const std::string& s) {
+    if (s.find_first_of(",\"\r\n") == std::string::npos) return s;
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string number(double value) {
+    std::ostringstream out;
+    out << std::setprecision(12) << value;
+    return out.str();
+}
+
+// Collects one command's totals and per-file rows and prints them in the
+// requested format. Values are stored already formatted; text values are
+// quoted in JSON, numbers are not.
+class Report {
+public:
+    Report(const std::string& command, std::vector<std::string> columns)
+        : columns(std::move(columns)) {
+        set("command", command);
+    }
+
+    void set(const std::string& key, const std::string& value) { totals.push_back({key, value, true}); }
+    void set(const std::string& key, uint64_t value) { totals.push_back({key, std::to_string(value), false}); }
+    void set(const std::string& key, double value) { totals.push_back({key, number(value), false}); }
+
+    // One value per column; columns listed in numeric are emitted unquoted
+    void row(std::vector<std::string> values) { rows.push_back(std::move(values)); }
+    void numeric(const std::string& column) { numericColumns.push_back(column); }
+
+    // out is stdout unless that carries data
+    void print(const std::string& format, std::ostream& out = std::cout) const {
+        if (format == "csv") printCsv(out);
+        else printJson(out);
+    }
+
+private:
+    struct Field {
+        std::string key;
+        std::string value;
+        bool quoted;
+    };
+
+    std::vector<std::string> columns;
+    std::vector<std::string> numericColumns;
+    std::vector<Field> totals;
+    std::vector<std::vector<std::string>> rows;
+
+    bool isNumeric(const std::string& column) const {
+        for (const auto& c : numericColumns) {
+            if (c == column) return true;
+        }
+        return false;
+    }
+
+    void printJson(std::ostream& out) const {
+        out << "{";
+        for (const auto& f : totals) {
+            out << jsonString(f.key) << ":" << (f.quoted ? jsonString(f.value) : f.value) << ",";
+        }
+        out << "\"items\":[";
+        for (size_t r = 0; r < rows.size(); ++r) {
+            out << (r ? ",\n" : "\n") << "{";
+            for (size_t c = 0; c < columns.size(); ++c) {
+                const std::string& v = rows[r][c];
+                out << (c ? "," : "") << jsonString(columns[c]) << ":"
+                    << (isNumeric(columns[c]) ? v : jsonString(v));
+            }
+            out << "}";
+        }
+        out << "]}" << std::endl;
+    }
+
+    void printCsv(std::ostream& out) const {
+        for (size_t c = 0; c < columns.size(); ++c) out << (c ? "," : "") << columns[c];
+        out << "\n";
+        for (const auto& r : rows) {
+            for (size_t c = 0; c < r.size(); ++c) out << (c ? "," : "") << csvField(r[c]);
+            out << "\n";
+        }
+        out.flush();
+
+        // Totals do not fit the row schema; keep them out of the data stream
+        for (size_t i = 0; i < totals.size(); ++i) {
+            std::cerr << (i ? " " : "") << totals[i].key << "=" << totals[i].value;
+        }
+        std::cerr << std::endl;
+    }
+};
+
+class Stopwatch {
+public:
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+};
+
+// Scan opts.path, reusing and refreshing the on-disk index unless disabled
+ScanResult scanTree(const Options& opts, std::string& indexPath) {
+    if (!fs::is_directory(opts.path)) throw std::runtime_error(opts.path + " is not a directory");
+
+    indexPath = opts.useIndex ? defaultIndexPath(opts.path) : std::string();
+    ScanIndex previous;
+    if (!indexPath.empty()) previous.load(indexPath, opts.hashes.fastHash, opts.hashes.strongHash);
+
+    ScanResult result = scanDirectory(opts.path, opts.threads, &previous);
+    if (!result.error.empty()) throw std::runtime_error(result.error);
+    if (!indexPath.empty()) ScanIndex::save(indexPath, result, opts.hashes.fastHash, opts.hashes.strongHash);
+    return result;
+}
+
+uint64_t totalBytes(const FileTable& files, const std::vector<FileTable::Id>& ids) {
+    uint64_t bytes = 0;
+    for (FileTable::Id id : ids) bytes += files.sizeOf(id);
+    return bytes;
+}
+
+int runScan(Options& opts) {
+    Stopwatch timer;
+    std::string indexPath;
+    ScanResult result = scanTree(opts, indexPath);
+
+    Report report("scan", {"path", "size", "type", "ageDays"});
+    report.numeric("size");
+    report.numeric("ageDays");
+    uint64_t bytes = 0;
+    for (auto f : result.files) {
+        report.row({f.path(), std::to_string(f.size()), std::string(f.type()), std::to_string(f.lastModified())});
+        bytes += f.size();
+    }
+    report.set("path", opts.path);
+    report.set("files", uint64_t(result.files.size()));
+    report.set("directories", uint64_t(result.files.directoryCount()));
+    report.set("directoriesReused", uint64_t(result.directoriesReused));
+    report.set("bytes", bytes);
+    report.set("seconds", timer.seconds());
+    report.print(opts.format);
+    return 0;
+}
+
+int runDedupe(Options& opts) {
+    requirePolicy(opts, {"report", "delete", "hardlink", "reflink"});
+    Stopwatch timer;
+    std::string indexPath;
+    ScanResult result = scanTree(opts, indexPath);
+
+    FileTable& files = result.files;
+    DuplicateStats stats;
+    auto groups = findDuplicates(files, &stats, opts.hashes);
+
+    // Visit groups in a stable order so runs are comparable
+    std::map<std::string, const std::vector<FileTable::Id>*> ordered;
+    for (const auto& pair : groups) {
+        if (pair.second.size() > 1) ordered[files.path(pair.second.front())] = &pair.second;
+    }
+
+    Report report("dedupe", {"group", "action", "path", "size"});
+    report.numeric("group");
+    report.numeric("size");
+    std::vector<FileTable::Id> removed;
+    uint64_t duplicates = 0, reclaimable = 0, freed = 0, failures = 0;
+    uint64_t groupNum = 0;
+    for (const auto& entry : ordered) {
+        const std::vector<FileTable::Id>& group = *entry.second;
+        const std::string& keep = entry.first;
+        ++groupNum;
+        report.row({std::to_string(groupNum), "keep", keep, std::to_string(files.sizeOf(group[0]))});
+        for (size_t i = 1; i < group.size(); ++i) {
+            FileTable::Ref dup = files[group[i]];
+            std::string dupPath = dup.path();
+            ++duplicates;
+            std::error_code ec;
+            if (dup.inode() != 0 && dup.inode() == files.inode(group[0]) && fs::equivalent(keep, dupPath, ec)) {
+                // Hard links found by the scan share storage already; inode
+                // numbers alone repeat across filesystems, so the device is
+                // compared too
+                report.row({std::to_string(groupNum), "linked", dupPath, std::to_string(dup.size())});
+                continue;
+            }
+            reclaimable += dup.size();
+            std::string action = "duplicate";
+            if (opts.policy != "report") {
+                DedupeAction how = DedupeAction::Delete;
+                if (opts.policy == "hardlink") how = DedupeAction::HardLink;
+                else if (opts.policy == "reflink") how = DedupeAction::Reflink;
+
+                std::string error;
+                if (dedupeFile(keep, dupPath, how, error)) {
+                    action = how == DedupeAction::Delete ? "deleted"
+                           : how == DedupeAction::HardLink ? "hardlinked" : "reflinked";
+                    if (how == DedupeAction::Delete) removed.push_back(dup.id());
+                    freed += dup.size();
+                } else {
+                    action = "failed";
+                    ++failures;
+                    std::cerr << "error: " << error << std::endl;
+                }
+            }
+            report.row({std::to_string(groupNum), action, dupPath, std::to_string(dup.size())});
+        }
+    }
+
+    // Keep the hashes just computed, minus the files that are gone
+    size_t removedCount = removed.size();
+    files.erase(std::move(removed));
+    if (!indexPath.empty()) ScanIndex::save(indexPath, result, opts.hashes.fastHash, opts.hashes.strongHash);
+
+    report.set("path", opts.path);
+    report.set("policy", opts.policy);
+    report.set("files", uint64_t(stats.filesConsidered));
+    report.set("groups", groupNum);
+    report.set("duplicates", duplicates);
+    report.set("reclaimableBytes", reclaimable);
+    report.set("removedFiles", uint64_t(removedCount));
+    report.set("freedBytes", freed);
+    report.set("failures", failures);
+    report.set("bytesRead", uint64_t(stats.bytesRead));
+    report.set("seconds", timer.seconds());
+    report.print(opts.format);
+    return failures ? 1 : 0;
+}
+
+BatchCompressOptions batchOptions(const Options& opts, bool replace) {
+    BatchCompressOptions batch;
+    batch.huffman.blockSize = opts.blockSize;
+    batch.huffman.threads = opts.threads;
+    batch.huffman.codec = opts.codec;
+    batch.jobs = opts.jobs;
+    batch.replace = replace;
+    return batch;
+}
+
+// Row action for a compressBatch result; errors go to stderr
+std::string batchAction(const FileTable& files, const BatchCompressResult& r) {
+    if (!r.error.empty()) std::cerr << "error: " << files.path(r.id) << ": " << r.error << std::endl;
+    if (r.output.empty()) return "failed";
+    return r.replaced ? "replaced" : "compressed";
+}
+
+int runRank(Options& opts) {
+    // No delete policy: without --capacity the whole disk is the budget and
+    // every file is selected, so a ranking must never remove anything
+    requirePolicy(opts, {"report", "compress"});
+    Stopwatch timer;
+    std::string indexPath;
+    ScanResult result = scanTree(opts, indexPath);
+
+    double capacity = opts.capacityMB > 0 ? opts.capacityMB : result.totalSpace;
+    optimizer opt(capacity);
+    RankingReport ranking;
+    const FileTable& files = result.files;
+    std::vector<FileTable::Id> ranked = opt.rankFilesKnapsack(files, &ranking);
+
+    // Compressible part of the selection, compressed as one batch
+    std::map<FileTable::Id, BatchCompressResult> compressed;
+    if (opts.policy == "compress") {
+        std::vector<FileTable::Id> compressible;
+        for (FileTable::Id id : ranked) {
+            if (opt.shouldCompress(files, id, &ranking)) compressible.push_back(id);
+        }
+        for (auto& r : compressBatch(files, compressible, batchOptions(opts, true))) compressed[r.id] = r;
+    }
+
+    Report report("rank", {"rank", "action", "path", "size", "type"});
+    report.numeric("rank");
+    report.numeric("size");
+    uint64_t freed = 0, failures = 0;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        FileTable::Ref f = files[ranked[i]];
+        std::string path = f.path();
+        std::string action = "selected";
+        if (opts.policy == "compress") {
+            auto it = compressed.find(f.id());
+            if (it == compressed.end()) {
+                action = "skipped"; // not worth compressing
+            } else {
+                action = batchAction(files, it->second);
+                if (action == "failed") ++failures;
+                if (it->second.replaced) freed += f.size() - std::min(f.size(), it->second.stats.outputBytes);
+            }
+        }
+        report.row({std::to_string(i + 1), action, path, std::to_string(f.size()), std::string(f.type())});
+    }
+
+    report.set("path", opts.path);
+    report.set("policy", opts.policy);
+    report.set("capacityMB", capacity);
+    report.set("method", ranking.method);
+    report.set("memoryBytes", uint64_t(ranking.memoryBytes));
+    report.set("value", ranking.value);
+    report.set("upperBound", ranking.upperBound);
+    report.set("files", uint64_t(result.files.size()));
+    report.set("selected", uint64_t(ranked.size()));
+    report.set("selectedBytes", totalBytes(files, ranked));
+    report.set("freedBytes", freed);
+    report.set("failures", failures);
+    report.set("seconds", timer.seconds());
+    report.print(opts.format);
+    return failures ? 1 : 0;
+}
+
+// Files a compress/decompress command applies to: --path itself, or the
+// matching files below it when it is a directory
+FileTable selectFiles(const Options& opts, bool compress, std::vector<FileTable::Id>& selected) {
+    FileTable files;
+    if (fs::is_directory(opts.path)) {
+        std::string indexPath;
+        files = std::move(scanTree(opts, indexPath).files);
+        optimizer opt(0);
+        for (auto f : files) {
+            bool huff = f.type() == ".huff";
+            if (compress ? !huff && opt.shouldCompress(files, f.id()) : huff) selected.push_back(f.id());
+        }
+    } else {
+        FileInfo info;
+        if (!statFile(opts.path, info)) throw std::runtime_error("Cannot open " + opts.path);
+        selected.push_back(files.add(info));
+    }
+    return files;
+}
+
+// A compress/decompress output under construction: written to a private
+// temporary next to it and moved into place only once complete. An existing
+// output is refused unless --force, and on failure only the temporary goes,
+// never a file this run did not create.
+class PendingOutput {
+public:
+    PendingOutput(const std::string& input, const std::string& output, bool force) : output(output), force(force) {
+        std::error_code ec;
+        if (fs::exists(fs::symlink_status(output, ec))) {
+            if (!force) throw std::runtime_error(output + " already exists (use --force to replace it)");
+            if (fs::equivalent(input, output, ec)) throw std::runtime_error("output " + output + " is the input");
+        }
+        temp = createTempFor(output);
+        if (temp.empty()) {
+            throw std::runtime_error("Cannot create a temporary file for " + output + ": " + std::strerror(errno));
+        }
+    }
+
+    ~PendingOutput() {
+        std::error_code ec;
+        if (!temp.empty()) fs::remove(temp, ec);
+    }
+
+    PendingOutput(const PendingOutput&) = delete;
+    PendingOutput& operator=(const PendingOutput&) = delete;
+
+    const std::string& path() const { return temp; }
+
+    // Give the result source's mode, owner and times ("" for stdin: a new
+    // file's default mode) and move it to the output name
+    void publish(const std::string& source) {
+        std::string error;
+        if (source.empty()) useDefaultMode(temp);
+        else if (!copyMetadata(source, temp, error)) throw std::runtime_error(error);
+        if (int err = publishFile(temp, output, force)) {
+            throw std::runtime_error(err == EEXIST ? output + " already exists (use --force to replace it)"
+                                                   : "Cannot rename to " + output + ": " + std::strerror(err));
+        }
+        temp.clear();
+    }
+
+private:
+    std::string output;
+    bool force;
+    std::string temp;
+};
+
+// compress/decompress with stdin or stdout on either side, in bounded memory
+int runStream(Options& opts, bool compress) {
+    requirePolicy(opts, {"keep"});
+    Stopwatch timer;
+    std::ios::sync_with_stdio(false);
+
+    std::ifstream inFile;
+    std::istream* in = &std::cin;
+    if (opts.path != "-") {
+        inFile.open(opts.path, std::ios::binary);
+        if (!inFile) throw std::runtime_error("Cannot open " + opts.path);
+        in = &inFile;
+    }
+    std::string output = opts.output.empty() ? "-" : opts.output;
+    std::ofstream outFile;
+    std::ostream* out = &std::cout;
+    std::unique_ptr<PendingOutput> pending;
+    if (output != "-") {
+        pending = std::make_unique<PendingOutput>(opts.path == "-" ? "" : opts.path, output, opts.force);
+        outFile.open(pending->path(), std::ios::binary | std::ios::trunc);
+        if (!outFile) throw std::runtime_error("Cannot create " + pending->path());
+        out = &outFile;
+    }
+
+    HuffmanOptions huffOptions;
+    huffOptions.blockSize = opts.blockSize;
+    huffOptions.threads = opts.threads;
+    huffOptions.codec = opts.codec;
+    HuffmanStats stats = compress ? compressStream(*in, *out, huffOptions) : decompressStream(*in, *out);
+    if (pending) {
+        outFile.close();
+        if (!outFile) throw std::runtime_error("Failed writing " + output);
+        pending->publish(opts.path == "-" ? "" : opts.path);
+    }
+
+    Report report(compress ? "compress" : "decompress",
+                  {"action", "path", "output", "codec", "inputBytes", "outputBytes", "seconds"});
+    report.numeric("inputBytes");
+    report.numeric("outputBytes");
+    report.numeric("seconds");
+    report.row({compress ? "compressed" : "decompressed", opts.path, output, stats.codec,
+                std::to_string(stats.inputBytes), std::to_string(stats.outputBytes), number(stats.seconds)});
+    report.set("path", opts.path);
+    report.set("policy", opts.policy);
+    report.set("files", uint64_t(1));
+    report.set("inputBytes", stats.inputBytes);
+    report.set("outputBytes", stats.outputBytes);
+    report.set("failures", uint64_t(0));
+    report.set("seconds", timer.seconds());
+    report.print(opts.format, output == "-" ? std::cerr : std::cout);
+    return 0;
+}
+
+// compress without --output: every file through compressBatch, so outputs
+// are verified and originals replaced atomically
+int runCompressBatch(const Options& opts, const FileTable& files, const std::vector<FileTable::Id>& selected,
+                     const Stopwatch& timer) {
+    std::vector<BatchCompressResult> results =
+        compressBatch(files, selected, batchOptions(opts, opts.policy == "replace"));
+
+    Report report("compress", {"action", "path", "output", "codec", "inputBytes", "outputBytes", "seconds"});
+    report.numeric("inputBytes");
+    report.numeric("outputBytes");
+    report.numeric("seconds");
+    uint64_t inputTotal = 0, outputTotal = 0, failures = 0;
+    for (const BatchCompressResult& r : results) {
+        std::string action = batchAction(files, r);
+        if (action == "failed") ++failures;
+        inputTotal += r.stats.inputBytes;
+        outputTotal += r.stats.outputBytes;
+        report.row({action, files.path(r.id), r.output, r.stats.codec, std::to_string(r.stats.inputBytes),
+                    std::to_string(r.stats.outputBytes), number(r.stats.seconds)});
+    }
+
+    report.set("path", opts.path);
+    report.set("policy", opts.policy);
+    report.set("files", uint64_t(selected.size()));
+    report.set("jobs", uint64_t(opts.jobs));
+    report.set("inputBytes", inputTotal);
+    report.set("outputBytes", outputTotal);
+    report.set("failures", failures);
+    report.set("seconds", timer.seconds());
+    report.print(opts.format);
+    return failures ? 1 : 0;
+}
+
+// Shared driver for compress and decompress: run op on every selected file,
+// then drop the source when the policy says so
+int runCodec(Options& opts, bool compress) {
+    if (opts.path == "-" || opts.output == "-") return runStream(opts, compress);
+    requirePolicy(opts, {"keep", "replace"});
+    if (!opts.output.empty() && fs::is_directory(opts.path)) {
+        throw UsageError("--output only applies to a single file");
+    }
+    Stopwatch timer;
+    std::vector<FileTable::Id> selected;
+    FileTable files = selectFiles(opts, compress, selected);
+    if (compress && opts.output.empty()) return runCompressBatch(opts, files, selected, timer);
+
+    HuffmanOptions huffOptions;
+    huffOptions.blockSize = opts.blockSize;
+    huffOptions.threads = opts.threads;
+    huffOptions.codec = opts.codec;
+
+    Report report(compress ? "compress" : "decompress",
+                  {"action", "path", "output", "codec", "inputBytes", "outputBytes", "seconds"});
+    report.numeric("inputBytes");
+    report.numeric("outputBytes");
+    report.numeric("seconds");
+    uint64_t inputTotal = 0, outputTotal = 0, failures = 0;
+    for (FileTable::Id id : selected) {
+        std::string path = files.path(id);
+        std::string output = opts.output;
+        if (output.empty()) {
+            if (compress) output = path + ".huff";
+            else output = files.type(id) == ".huff" ? path.substr(0, path.size() - 5) : path + ".out";
+        }
+
+        HuffmanStats stats;
+        std::string action = compress ? "compressed" : "decompressed";
+        try {
+            PendingOutput pending(path, output, opts.force);
+            stats = compress ? compressFile(path, pending.path(), huffOptions) : decompressFile(path, pending.path());
+            // Same check compressBatch makes before an original is given up
+            if (compress && opts.policy == "replace" && !verifyCompressed(pending.path(), path)) {
+                throw std::runtime_error("verification failed");
+            }
+            pending.publish(path);
+            inputTotal += stats.inputBytes;
+            outputTotal += stats.outputBytes;
+            if (opts.policy == "replace") {
+                std::error_code ec;
+                if (fs::remove(path, ec)) action = "replaced";
+                else std::cerr << "error: cannot remove " << path << ": " << ec.message() << std::endl;
+            }
+        } catch (const std::invalid_argument&) {
+            throw; // bad --block-size or --codec, same for every file
+        } catch (const std::exception& e) {
+            action = "failed";
+            ++failures;
+            std::cerr << "error: " << path << ": " << e.what() << std::endl;
+        }
+        report.row({action, path, output, stats.codec, std::to_string(stats.inputBytes),
+                    std::to_string(stats.outputBytes), number(stats.seconds)});
+    }
+
+    report.set("path", opts.path);
+    report.set("policy", opts.policy);
+    report.set("files", uint64_t(selected.size()));
+    report.set("inputBytes", inputTotal);
+    report.set("outputBytes", outputTotal);
+    report.set("failures", failures);
+    report.set("seconds", timer.seconds());
+    report.print(opts.format);
+    return failures ? 1 : 0;
+}
+
+} // namespace
+
+int runBatch(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "help" || command == "--help" || command == "-h") {
+        std::cout << USAGE;
+        return 0;
+    }
+
+    try {
+        Options opts = parseOptions(argc, argv);
+        if (!opts.trace.empty()) instrument::startTrace();
+        int status;
+        if (command == "scan") status = runScan(opts);
+        else if (command == "dedupe") status = runDedupe(opts);
+        else if (command == "rank") status = runRank(opts);
+        else if (command == "compress") status = runCodec(opts, true);
+        else if (command == "decompress") status = runCodec(opts, false);
+        else throw UsageError("unknown command '" + command + "'");
+
+        if (opts.profile) Summary::printPhases(instrument::snapshot(), std::cerr);
+        if (!opts.trace.empty()) instrument::writeTrace(opts.trace);
+        return status;
+    } catch (const UsageError& e) {
+        std::cerr << "error: " << e.what() << "\n\n" << USAGE;
+        return 2;
+    } catch (const std::invalid_argument& e) {
+        // Unknown hash or codec name, or out-of-range block size
+        std::cerr << "error: " << e.what() << std::endl;
+        return 2;
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+}
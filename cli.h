@@ -0,0 +1,14 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Non-interactive entry point for scripted pipelines:
+//
+//   storage_optimizer <command> --path <path> [options]
+//
+// Commands are scan, dedupe, rank, compress and decompress. Results go to
+// stdout as JSON (default) or CSV, diagnostics to stderr, and nothing ever
+// prompts. Exit status is 0 on success, 1 if any operation failed and 2 for
+// a usage error.
+int runBatch(int argc, char* argv[]);
+
+#endif
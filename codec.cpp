@@ -0,0 +1,335 @@
+#include "codec.h"
+#include "huffman.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+namespace {
+
+const uint8_t ID_HUFFMAN = 0;
+const uint8_t ID_RLE = 1;
+const uint8_t ID_LZ77 = 2;
+const uint8_t ID_STORE = 3;
+
+class HuffmanCodec : public Codec {
+public:
+    const char* name() const override { return "huffman"; }
+    uint8_t id() const override { return ID_HUFFMAN; }
+
+    size_t encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const override {
+        return huffmanEncode(data, size, out);
+    }
+
+    void decode(const unsigned char* table, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                unsigned char* out, size_t rawSize) const override {
+        decodeBlock(table, tableSize, payload, payloadSize, out, rawSize);
+    }
+};
+
+class StoreCodec : public Codec {
+public:
+    const char* name() const override { return "store"; }
+    uint8_t id() const override { return ID_STORE; }
+
+    size_t encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const override {
+        out.insert(out.end(), data, data + size);
+        return 0;
+    }
+
+    void decode(const unsigned char*, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                unsigned char* out, size_t rawSize) const override {
+        if (tableSize != 0 || payloadSize != rawSize) throw std::runtime_error("Corrupt stored block");
+        std::memcpy(out, payload, rawSize);
+    }
+};
+
+// Control byte c < 128: c + 1 literal bytes follow. c >= 128: the next byte
+// repeats c - 125 times (3..130).
+class RleCodec : public Codec {
+public:
+    const char* name() const override { return "rle"; }
+    uint8_t id() const override { return ID_RLE; }
+
+    size_t encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const override {
+        size_t i = 0, literalStart = 0;
+        auto flushLiterals = [&](size_t end) {
+            while (literalStart < end) {
+                size_t n = std::min<size_t>(end - literalStart, 128);
+                out.push_back(static_cast<unsigned char>(n - 1));
+                out.insert(out.end(), data + literalStart, data + literalStart + n);
+                literalStart += n;
+            }
+        };
+        while (i < size) {
+            size_t run = 1;
+            while (i + run < size && run < 130 && data[i + run] == data[i]) ++run;
+            if (run >= 3) {
+                flushLiterals(i);
+                out.push_back(static_cast<unsigned char>(run + 125));
+                out.push_back(data[i]);
+                i += run;
+                literalStart = i;
+            } else {
+                i += run;
+            }
+        }
+        flushLiterals(size);
+        return 0;
+    }
+
+    void decode(const unsigned char*, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                unsigned char* out, size_t rawSize) const override {
+        if (tableSize != 0) throw std::runtime_error("Corrupt RLE block");
+        size_t in = 0, pos = 0;
+        while (in < payloadSize) {
+            unsigned c = payload[in++];
+            if (c < 128) {
+                size_t n = c + 1;
+                if (n > payloadSize - in || n > rawSize - pos) throw std::runtime_error("Corrupt RLE block");
+                std::memcpy(out + pos, payload + in, n);
+                in += n;
+                pos += n;
+            } else {
+                size_t n = c - 125;
+                if (in == payloadSize || n > rawSize - pos) throw std::runtime_error("Corrupt RLE block");
+                std::memset(out + pos, payload[in++], n);
+                pos += n;
+            }
+        }
+        if (pos != rawSize) throw std::runtime_error("Corrupt RLE block");
+    }
+};
+
+// LZ77 with a hash-chain match finder. Matches are found within the last
+// 64 KiB, then written as LZ4-style sequences (token with literal and match
+// length nibbles, extra length bytes, literals, 16-bit offset), and that
+// byte stream goes through the Huffman coder. The payload starts with the
+// u32 length of the sequence stream.
+class Lz77Codec : public Codec {
+public:
+    const char* name() const override { return "lz77"; }
+    uint8_t id() const override { return ID_LZ77; }
+
+    size_t encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const override {
+        Scratch& scratch = threadScratch();
+        std::vector<unsigned char>& sequences = scratch.sequences;
+        sequences.clear();
+        sequences.reserve(size / 2 + 16);
+        findMatches(data, size, sequences, scratch);
+
+        std::vector<unsigned char>& coded = scratch.coded;
+        coded.clear();
+        size_t tableSize = huffmanEncode(sequences.data(), sequences.size(), coded);
+        out.insert(out.end(), coded.begin(), coded.begin() + tableSize);
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<unsigned char>(sequences.size() >> (8 * i)));
+        out.insert(out.end(), coded.begin() + tableSize, coded.end());
+        scratch.trim();
+        return tableSize;
+    }
+
+    void decode(const unsigned char* table, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                unsigned char* out, size_t rawSize) const override {
+        if (payloadSize < 4) throw std::runtime_error("Corrupt LZ77 block");
+        size_t length = 0;
+        for (int i = 3; i >= 0; --i) length = (length << 8) | payload[i];
+        // A sequence stream is never much longer than its output
+        if (length > rawSize + rawSize / 255 + 16) throw std::runtime_error("Corrupt LZ77 block");
+
+        Scratch& scratch = threadScratch();
+        std::vector<unsigned char>& sequences = scratch.sequences;
+        sequences.resize(length);
+        decodeBlock(table, tableSize, payload + 4, payloadSize - 4, sequences.data(), length);
+        expand(sequences.data(), length, out, rawSize);
+        scratch.trim();
+    }
+
+private:
+    static const size_t WINDOW = 65535;
+    static const size_t MIN_MATCH = 4;
+    static const int HASH_BITS = 15;
+    static const int MAX_CHAIN = 32;
+
+    // Per-thread working buffers, reused from block to block. A block larger
+    // than usual may grow them; past SCRATCH_KEEP_LIMIT they are released.
+    static const size_t SCRATCH_KEEP_LIMIT = 16 << 20;
+
+    struct Scratch {
+        std::vector<unsigned char> sequences;
+        std::vector<unsigned char> coded;
+        std::vector<uint32_t> head;
+        std::vector<uint32_t> chain;
+
+        void trim() {
+            size_t held = sequences.capacity() + coded.capacity() + (head.capacity() + chain.capacity()) * 4;
+            if (held > SCRATCH_KEEP_LIMIT) *this = Scratch();
+        }
+    };
+
+    static Scratch& threadScratch() {
+        thread_local Scratch scratch;
+        return scratch;
+    }
+
+    static uint32_t hash4(const unsigned char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void putLength(std::vector<unsigned char>& out, size_t extra) {
+        while (extra >= 255) {
+            out.push_back(255);
+            extra -= 255;
+        }
+        out.push_back(static_cast<unsigned char>(extra));
+    }
+
+    static void putSequence(std::vector<unsigned char>& out, const unsigned char* literals, size_t literalCount,
+                            size_t offset, size_t matchLength) {
+        size_t m = matchLength ? matchLength - MIN_MATCH : 0;
+        out.push_back(static_cast<unsigned char>(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(m, 15)));
+        if (literalCount >= 15) putLength(out, literalCount - 15);
+        out.insert(out.end(), literals, literals + literalCount);
+        if (matchLength == 0) return; // last sequence
+        out.push_back(static_cast<unsigned char>(offset));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+        if (m >= 15) putLength(out, m - 15);
+    }
+
+    static void findMatches(const unsigned char* data, size_t size, std::vector<unsigned char>& out, Scratch& scratch) {
+        std::vector<uint32_t>& head = scratch.head;
+        std::vector<uint32_t>& chain = scratch.chain;
+        head.assign(size_t(1) << HASH_BITS, UINT32_MAX);
+        chain.resize(size); // entries are written before they are read
+        auto insert = [&](size_t pos) {
+            uint32_t h = hash4(data + pos);
+            chain[pos] = head[h];
+            head[h] = static_cast<uint32_t>(pos);
+        };
+
+        size_t pos = 0, literalStart = 0;
+        while (pos + MIN_MATCH <= size) {
+            size_t bestLength = 0, bestOffset = 0;
+            uint32_t candidate = head[hash4(data + pos)];
+            for (int depth = 0; depth < MAX_CHAIN && candidate != UINT32_MAX && pos - candidate <= WINDOW; ++depth) {
+                const unsigned char* a = data + candidate;
+                const unsigned char* b = data + pos;
+                size_t limit = size - pos, length = 0;
+                while (length < limit && a[length] == b[length]) ++length;
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestOffset = pos - candidate;
+                }
+                candidate = chain[candidate];
+            }
+
+            if (bestLength < MIN_MATCH) {
+                insert(pos++);
+                continue;
+            }
+            putSequence(out, data + literalStart, pos - literalStart, bestOffset, bestLength);
+            size_t end = pos + bestLength;
+            for (; pos < end; ++pos) {
+                if (pos + MIN_MATCH <= size) insert(pos);
+            }
+            literalStart = pos;
+        }
+        putSequence(out, data + literalStart, size - literalStart, 0, 0);
+    }
+
+    static size_t getLength(const unsigned char* in, size_t size, size_t& i) {
+        size_t extra = 0;
+        unsigned char b;
+        do {
+            if (i >= size) throw std::runtime_error("Corrupt LZ77 block");
+            b = in[i++];
+            extra += b;
+        } while (b == 255);
+        return extra;
+    }
+
+    static void expand(const unsigned char* in, size_t size, unsigned char* out, size_t rawSize) {
+        size_t i = 0, pos = 0;
+        while (true) {
+            if (i >= size) throw std::runtime_error("Corrupt LZ77 block");
+            unsigned token = in[i++];
+            size_t literals = token >> 4;
+            if (literals == 15) literals += getLength(in, size, i);
+            if (literals > size - i || literals > rawSize - pos) throw std::runtime_error("Corrupt LZ77 block");
+            std::memcpy(out + pos, in + i, literals);
+            i += literals;
+            pos += literals;
+            if (i == size) break; // last sequence has no match
+
+            if (size - i < 2) throw std::runtime_error("Corrupt LZ77 block");
+            size_t offset = in[i] | size_t(in[i + 1]) << 8;
+            i += 2;
+            size_t length = (token & 15) + MIN_MATCH;
+            if ((token & 15) == 15) length += getLength(in, size, i);
+            if (offset == 0 || offset > pos || length > rawSize - pos) throw std::runtime_error("Corrupt LZ77 block");
+            // Byte by byte: the source may overlap the bytes being written
+            for (size_t k = 0; k < length; ++k, ++pos) out[pos] = out[pos - offset];
+        }
+        if (pos != rawSize) throw std::runtime_error("Corrupt LZ77 block");
+    }
+};
+
+const HuffmanCodec huffmanCodec;
+const RleCodec rleCodec;
+const Lz77Codec lz77Codec;
+const StoreCodec storeCodec;
+const Codec* const ALL_CODECS[] = {&huffmanCodec, &rleCodec, &lz77Codec, &storeCodec};
+
+const size_t TRIAL_WINDOW = 16384;
+const size_t TRIAL_WINDOWS = 4;
+
+} // namespace
+
+const Codec* findCodec(const std::string& name) {
+    for (const Codec* codec : ALL_CODECS) {
+        if (name == codec->name()) return codec;
+    }
+    return nullptr;
+}
+
+const Codec* codecById(uint8_t id) {
+    for (const Codec* codec : ALL_CODECS) {
+        if (codec->id() == id) return codec;
+    }
+    return nullptr;
+}
+
+std::vector<std::string> codecNames() {
+    std::vector<std::string> names;
+    for (const Codec* codec : ALL_CODECS) names.push_back(codec->name());
+    return names;
+}
+
+CodecTrial chooseCodec(const unsigned char* data, size_t size) {
+    // Windows are contiguous so LZ77 sees the repeats a real block would
+    size_t windows = size <= TRIAL_WINDOW * TRIAL_WINDOWS ? 1 : TRIAL_WINDOWS;
+    size_t window = windows == 1 ? size : TRIAL_WINDOW;
+    size_t stride = windows == 1 ? 0 : (size - window) / (windows - 1);
+
+    CodecTrial best;
+    best.codec = &storeCodec;
+    if (size == 0) return best;
+
+    // Trial output is at most a few windows, so it is kept for the next call
+    thread_local std::vector<unsigned char> out;
+    for (const Codec* codec : ALL_CODECS) {
+        if (codec == &storeCodec) continue;
+        size_t coded = 0;
+        for (size_t w = 0; w < windows; ++w) {
+            out.clear();
+            codec->encode(data + w * stride, window, out);
+            coded += out.size();
+        }
+        double ratio = static_cast<double>(coded) / (window * windows);
+        if (ratio < best.ratio) {
+            best.codec = codec;
+            best.ratio = ratio;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,50 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Block codec of the .huff container. Each block records the id of the codec
+// that produced it, so a file can mix codecs. A block's coded form is an
+// optional table followed by a payload; the container stores both sizes.
+class Codec {
+public:
+    virtual ~Codec() = default;
+
+    virtual const char* name() const = 0;
+    virtual uint8_t id() const = 0;
+
+    // Append the coded form of data to out; returns how many of the appended
+    // bytes are table (0 for codecs without one)
+    virtual size_t encode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) const = 0;
+
+    // Reverse encode into exactly rawSize bytes at out. Corrupt input throws
+    // std::runtime_error.
+    virtual void decode(const unsigned char* table, size_t tableSize, const unsigned char* payload,
+                        size_t payloadSize, unsigned char* out, size_t rawSize) const = 0;
+};
+
+// Available codecs:
+//   "huffman" - order-0 canonical Huffman (the original format)
+//   "lz77"    - hash-chain LZ77 over a 64 KiB window, tokens Huffman-coded
+//   "rle"     - byte run-length coding, for long runs of one value
+//   "store"   - raw bytes, used for blocks nothing else shrinks
+// Codecs are stateless singletons. findCodec returns nullptr for an unknown
+// name, codecById for an unknown id.
+const Codec* findCodec(const std::string& name);
+const Codec* codecById(uint8_t id);
+std::vector<std::string> codecNames();
+
+// Result of trying every codec on a sample
+struct CodecTrial {
+    const Codec* codec = nullptr;
+    double ratio = 1.0; // coded / original size of the sample
+};
+
+// Trial-encode a few evenly spaced windows of data with each codec and pick
+// the one with the smallest output
+CodecTrial chooseCodec(const unsigned char* data, size_t size);
+
+#endif
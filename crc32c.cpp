@@ -0,0 +1,77 @@
+#include "crc32c.h"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+namespace {
+
+const uint32_t POLY = 0x82f63b78; // reflected Castagnoli polynomial
+
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (POLY & (0u - (c & 1)));
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xff];
+        }
+    }
+};
+
+uint32_t crcSoftware(uint32_t crc, const unsigned char* p, size_t size) {
+    static const Tables tables;
+    const auto& t = tables.t;
+
+    while (size >= 8) {
+        uint32_t lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        lo = __builtin_bswap32(lo);
+        hi = __builtin_bswap32(hi);
+#endif
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+uint32_t crcHardware(uint32_t crc, const unsigned char* p, size_t size) {
+    uint64_t c = crc;
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        size -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (size--) c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+#endif
+
+} // namespace
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+    const auto* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#ifdef CRC32C_HAVE_SSE42
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) return ~crcHardware(crc, p, size);
+#endif
+    return ~crcSoftware(crc, p, size);
+}
@@ -0,0 +1,12 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32C (Castagnoli). Pass the previous result as `crc` to checksum data
+// in pieces; start from 0. Uses the SSE4.2 crc32 instruction when the CPU
+// has it, slicing-by-8 tables otherwise.
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+#endif
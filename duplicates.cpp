@@ -1,66 +1,393 @@
 #include "duplicates.h"
-#include <iostream>
+#include "mappedfile.h"
+#include "batchreader.h"
+#include "instrument.h"
 #include <vector>
 #include <unordered_map>
-#include <fstream>
 #include <string>
 #include <algorithm>
+#include <atomic>
+#include <stdexcept>
 #include <filesystem>
+#include <cstring>
+#include <cerrno>
 
-std::string hash(const std::string& filepath) {
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file) {
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#endif
+
+// Bytes read from each end of a file in the partial hash stage
+static const uintmax_t PARTIAL_BYTES = 4096;
+
+// Files up to this size are read through the BatchReader; past it the data
+// outweighs the per-file system calls and mapping the file is cheaper
+static const uintmax_t BATCH_READ_LIMIT = 1024 * 1024;
+
+static std::unique_ptr<Hasher> requireHasher(const std::string& name) {
+    auto hasher = makeHasher(name);
+    if (!hasher) throw std::invalid_argument("Unknown hash algorithm: " + name);
+    return hasher;
+}
+
+static std::string hashFile(const Hasher& hasher, const std::string& filepath, uintmax_t* bytesRead) {
+    MappedFile file(filepath, MappedFile::Sequential);
+    if (!file.isOpen()) {
         return "";
     }
     
-    unsigned long long hash = 0;
-    char buffer[4096];
-    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
-        std::streamsize bytesRead = file.gcount();
-        for (std::streamsize i = 0; i < bytesRead; ++i) {
-            hash = hash * 31 + static_cast<unsigned char>(buffer[i]);
+    *bytesRead += file.size();
+    return hasher.hash(file.data(), file.size());
+}
+
+// Hash only the first and last PARTIAL_BYTES of a file
+static std::string partialHash(const Hasher& hasher, const std::string& filepath, uintmax_t* bytesRead) {
+    MappedFile file(filepath, MappedFile::Random);
+    if (!file.isOpen()) {
+        return "";
+    }
+
+    size_t head = std::min<size_t>(PARTIAL_BYTES, file.size());
+    size_t tail = std::min<size_t>(PARTIAL_BYTES, file.size());
+    *bytesRead += head + tail;
+
+    return hasher.hash(file.data(), head) + hasher.hash(file.data() + file.size() - tail, tail);
+}
+
+// Regroup every bucket by a key computed per file, dropping groups that end
+// up alone. Each surviving group carries the key its members share.
+struct Candidates {
+    std::string key;
+    std::vector<FileTable::Id> ids;
+};
+
+template <typename KeyFn>
+static std::vector<Candidates> splitGroups(std::vector<Candidates>& groups, KeyFn key) {
+    std::vector<Candidates> result;
+    for (auto& group : groups) {
+        std::unordered_map<std::string, std::vector<FileTable::Id>> byKey;
+        for (FileTable::Id id : group.ids) {
+            std::string k = key(id);
+            if (k.empty()) continue; // unreadable
+            byKey[k].push_back(id);
+        }
+        for (auto& pair : byKey) {
+            if (pair.second.size() > 1) {
+                result.push_back({pair.first, std::move(pair.second)});
+            }
         }
     }
-    
-    char hexStr[17];
-    snprintf(hexStr, sizeof(hexStr), "%016llx", hash);
-    return std::string(hexStr);
+    return result;
 }
 
-std::unordered_map<std::string, std::vector<FileInfo>> findDuplicates(const std::vector<FileInfo>& files) {
-    std::unordered_map<std::string, std::vector<FileInfo>> groups;
-    
-    for (const auto& f : files) {
-        std::string fileHash = hash(f.path);
-        groups[fileHash].push_back(f);
+// Hash the files of groups with many reads in flight at once: head and tail
+// for a partial hash (same key as partialHash), otherwise the whole file.
+// Files above BATCH_READ_LIMIT and ids for which skip() holds are left out
+// for the caller to hash one by one. Unreadable files map to "".
+template <typename Skip>
+static std::unordered_map<FileTable::Id, std::string> batchHash(BatchReader& reader, const FileTable& files,
+                                                                const std::vector<Candidates>& groups,
+                                                                const Hasher& hasher, bool partial, Skip skip,
+                                                                uintmax_t* bytesRead) {
+    std::vector<FileTable::Id> ids;
+    std::vector<ReadRequest> requests;
+    for (const auto& group : groups) {
+        for (FileTable::Id id : group.ids) {
+            uint64_t size = files.sizeOf(id);
+            if (skip(id) || (!partial && size > BATCH_READ_LIMIT)) continue;
+            ReadRequest request;
+            request.path = files.path(id);
+            request.size = size;
+            request.head = partial ? std::min<uint64_t>(PARTIAL_BYTES, size) : size;
+            request.tail = partial ? std::min<uint64_t>(PARTIAL_BYTES, size - request.head) : 0;
+            ids.push_back(id);
+            requests.push_back(std::move(request));
+        }
     }
-    
-    return groups;
+
+    // Each call fills its own slot, so the thread engine needs no lock
+    std::vector<std::string> hashes(ids.size());
+    std::atomic<uintmax_t> read{0};
+    reader.read(requests, [&](size_t i, const unsigned char* data, size_t size, int error) {
+        if (error) return;
+        read += size;
+        if (partial) {
+            size_t head = std::min(requests[i].head, size);
+            hashes[i] = hasher.hash(data, head) + hasher.hash(data + head, size - head);
+        } else {
+            hashes[i] = hasher.hash(data, size);
+        }
+    });
+    *bytesRead += read;
+
+    std::unordered_map<FileTable::Id, std::string> result;
+    result.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) result.emplace(ids[i], std::move(hashes[i]));
+    return result;
 }
 
-void handleDuplicates(std::vector<FileInfo>& files) {
-    auto groups = findDuplicates(files);
-    
-    int groupNum = 1;
-    for (const auto& pair : groups) {
-        if (pair.second.size() > 1) {
-            std::cout << "=== Duplicate group " << groupNum << " ===" << std::endl;
-            for (const auto& file : pair.second) {
-                std::filesystem::path p(file.path);
-                std::cout << "- " << p.filename().string() << " (" << file.path << ")" << std::endl;
-            }
-            
-            std::cout << "Do you want to delete duplicates? (y/n): ";
-            char choice;
-            std::cin >> choice;
-            
-            if (choice == 'y' || choice == 'Y') {
-                for (size_t i = 1; i < pair.second.size(); ++i) {
-                    std::filesystem::remove(pair.second[i].path);
-                    std::cout << "Deleted: " << pair.second[i].path << std::endl;
-                }
+static size_t countIds(const std::vector<Candidates>& groups) {
+    size_t n = 0;
+    for (const auto& group : groups) n += group.ids.size();
+    return n;
+}
+
+// Order a group by path so the kept copy is always the same one
+static void sortByPath(const FileTable& files, std::vector<FileTable::Id>& ids) {
+    std::vector<std::pair<std::string, FileTable::Id>> keyed;
+    for (FileTable::Id id : ids) keyed.emplace_back(files.path(id), id);
+    std::sort(keyed.begin(), keyed.end());
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = keyed[i].second;
+}
+
+DuplicateGroups findDuplicates(FileTable& files, DuplicateStats* stats, const DuplicateOptions& options) {
+    instrument::PhaseTimer timer(instrument::Phase::Hash);
+    auto fast = requireHasher(options.fastHash);
+    auto strong = options.strongHash.empty() ? nullptr : requireHasher(options.strongHash);
+
+    // Cached digests from another algorithm would never match fresh ones
+    if (files.fastHashName() != options.fastHash) files.resetFastDigests(options.fastHash);
+    if (strong && files.strongHashName() != options.strongHash) files.resetStrongDigests(options.strongHash);
+
+    DuplicateStats local;
+    DuplicateStats& st = stats ? *stats : local;
+    st = DuplicateStats();
+
+    // Stage 1: only files with the same size can be identical
+    const std::vector<uint64_t>& sizes = files.sizes();
+    std::unordered_map<uint64_t, std::vector<FileTable::Id>> bySize;
+    for (FileTable::Id id = 0; id < sizes.size(); ++id) {
+        bySize[sizes[id]].push_back(id);
+        st.bytesTotal += sizes[id];
+    }
+    st.filesConsidered = sizes.size();
+
+    DuplicateGroups groups;
+    std::vector<Candidates> small, large;
+    for (auto& pair : bySize) {
+        // Empty files are alike but not copies of each other; often they are
+        // markers whose identity matters, and merging them frees nothing
+        if (pair.second.size() < 2 || pair.first == 0) continue;
+        st.sizeCandidates += pair.second.size();
+
+        bool allCached = std::all_of(pair.second.begin(), pair.second.end(),
+                                     [&](FileTable::Id id) { return !files.fastDigest(id).empty(); });
+        if (pair.first <= 2 * PARTIAL_BYTES || allCached) {
+            // Head and tail would cover the whole file anyway, or the full
+            // hashes are already known
+            small.push_back({std::string(), std::move(pair.second)});
+        } else {
+            large.push_back({std::string(), std::move(pair.second)});
+        }
+    }
+
+    // Small reads dominate the hashing stages, so they go through one
+    // batch reader with many requests in flight
+    BatchReader reader;
+
+    // Stage 2: head/tail hash of same-size candidates
+    ProgressReporter partialProgress(options.progress, "partial-hash", countIds(large));
+    instrument::TraceScope partialTrace("partial-hash");
+    auto partials = batchHash(reader, files, large, *fast, true, [](FileTable::Id) { return false; },
+                              &st.bytesRead);
+    large = splitGroups(large, [&](FileTable::Id id) {
+        partialProgress.advance();
+        st.partialHashed++;
+        auto it = partials.find(id);
+        return it != partials.end() ? it->second : partialHash(*fast, files.path(id), &st.bytesRead);
+    });
+
+    // Stage 3: full hash of the survivors, kept in the table for next time
+    for (auto& group : large) small.push_back(std::move(group));
+    ProgressReporter fullProgress(options.progress, "full-hash", countIds(small));
+    instrument::TraceScope fullTrace("full-hash");
+    auto fulls = batchHash(reader, files, small, *fast, false,
+                           [&](FileTable::Id id) { return !files.fastDigest(id).empty(); }, &st.bytesRead);
+    auto confirmed = splitGroups(small, [&](FileTable::Id id) {
+        fullProgress.advance();
+        Digest<16>& digest = files.fastDigest(id);
+        if (!digest.empty()) {
+            st.hashesReused++;
+            return digest.hex();
+        }
+        st.fullHashed++;
+        auto it = fulls.find(id);
+        std::string hash = it != fulls.end() ? it->second : hashFile(*fast, files.path(id), &st.bytesRead);
+        digest.setHex(hash);
+        return hash;
+    });
+
+    // Stage 4: confirm with the strong hash so nothing is deleted on a
+    // fast-hash collision
+    if (strong) {
+        ProgressReporter strongProgress(options.progress, "strong-hash", countIds(confirmed));
+        instrument::TraceScope strongTrace("strong-hash");
+        auto strongs = batchHash(reader, files, confirmed, *strong, false,
+                                 [&](FileTable::Id id) { return !files.strongDigest(id).empty(); }, &st.bytesRead);
+        confirmed = splitGroups(confirmed, [&](FileTable::Id id) {
+            strongProgress.advance();
+            Digest<32>& digest = files.strongDigest(id);
+            if (!digest.empty()) {
+                st.hashesReused++;
+                return digest.hex();
             }
-            groupNum++;
+            st.strongHashed++;
+            auto it = strongs.find(id);
+            std::string hash = it != strongs.end() ? it->second : hashFile(*strong, files.path(id), &st.bytesRead);
+            digest.setHex(hash);
+            return hash;
+        });
+    }
+
+    instrument::addBytes(instrument::Phase::Hash, st.bytesRead);
+    instrument::addFiles(instrument::Phase::Hash, st.partialHashed + st.fullHashed + st.strongHashed);
+
+    for (auto& group : confirmed) {
+        sortByPath(files, group.ids);
+        std::string key = std::to_string(files.sizeOf(group.ids.front())) + "-" + group.key;
+        groups[key] = std::move(group.ids);
+    }
+
+    return groups;
+}
+
+// Byte-wise comparison right before a destructive step, so a file edited
+// since it was hashed (or a hash collision) never gets linked or removed
+static bool sameContents(const std::string& a, const std::string& b, uint64_t& size, std::string& error) {
+    MappedFile first(a, MappedFile::Sequential), second(b, MappedFile::Sequential);
+    if (!first.isOpen() || !second.isOpen()) {
+        error = "cannot read " + (first.isOpen() ? b : a);
+        return false;
+    }
+    if (first.size() != second.size() || std::memcmp(first.data(), second.data(), first.size()) != 0) {
+        error = b + " no longer matches " + a;
+        return false;
+    }
+    size = first.size();
+    return true;
+}
+
+// A name next to path for building the replacement before it is renamed over
+static std::string siblingTemp(const std::string& path) {
+    return path + ".dedupe-tmp";
+}
+
+static bool replaceWithHardLink(const std::string& keep, const std::string& dup, std::string& error) {
+    std::string temp = siblingTemp(dup);
+    std::error_code ec;
+    std::filesystem::remove(temp, ec);
+    std::filesystem::create_hard_link(keep, temp, ec);
+    if (!ec) std::filesystem::rename(temp, dup, ec); // atomic: dup never goes missing
+    if (ec) {
+        std::error_code ignored;
+        std::filesystem::remove(temp, ignored);
+        error = "cannot link " + dup + " to " + keep + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+static bool unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == EINVAL || err == EXDEV;
+}
+
+// Ask the filesystem to share keep's extents with dup. The kernel locks both
+// files and compares them again, so dup keeps its inode, owner and mode and
+// is left alone if it changed. Returns the errno of the first failure.
+static int dedupeRange(int src, int dst, uint64_t size, bool& differs) {
+    const uint64_t CHUNK = 16 * 1024 * 1024; // per-call limit on some filesystems
+    std::vector<unsigned char> buffer(sizeof(file_dedupe_range) + sizeof(file_dedupe_range_info));
+    file_dedupe_range* range = reinterpret_cast<file_dedupe_range*>(buffer.data());
+
+    uint64_t offset = 0;
+    while (offset < size) {
+        std::fill(buffer.begin(), buffer.end(), 0);
+        range->src_offset = offset;
+        range->src_length = std::min(CHUNK, size - offset);
+        range->dest_count = 1;
+        range->info[0].dest_fd = dst;
+        range->info[0].dest_offset = offset;
+
+        if (ioctl(src, FIDEDUPERANGE, range) != 0) return errno;
+        if (range->info[0].status == FILE_DEDUPE_RANGE_DIFFERS) {
+            differs = true;
+            return 0;
+        }
+        if (range->info[0].status < 0) return -range->info[0].status;
+        if (range->info[0].bytes_deduped == 0) return EINVAL;
+        offset += range->info[0].bytes_deduped;
+    }
+    return 0;
+}
+
+static bool shareExtents(const std::string& keep, const std::string& dup, uint64_t size, std::string& error) {
+    int src = open(keep.c_str(), O_RDONLY | O_CLOEXEC);
+    if (src < 0) {
+        error = "cannot open " + keep + ": " + std::strerror(errno);
+        return false;
+    }
+    // Writable if we can; the kernel accepts read-only for the file's owner
+    int dst = open(dup.c_str(), O_RDWR | O_CLOEXEC);
+    if (dst < 0) dst = open(dup.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dst < 0) {
+        error = "cannot open " + dup + ": " + std::strerror(errno);
+        close(src);
+        return false;
+    }
+
+    bool differs = false;
+    int err = dedupeRange(src, dst, size, differs);
+    close(dst);
+    close(src);
+
+    if (differs) {
+        error = dup + " changed while it was being deduplicated";
+        return false;
+    }
+    if (err) {
+        error = "cannot share extents of " + dup + " with " + keep + ": " +
+                (unsupported(err) ? std::string("filesystem cannot share extents in place") : std::strerror(err));
+        return false;
+    }
+    return true;
+}
+#else
+static bool shareExtents(const std::string&, const std::string& dup, uint64_t, std::string& error) {
+    error = "cannot reflink " + dup + ": not supported on this platform";
+    return false;
+}
+#endif
+
+bool dedupeFile(const std::string& keep, const std::string& dup, DedupeAction action, std::string& error) {
+    if (keep == dup) {
+        error = "refusing to remove the kept copy " + keep;
+        return false;
+    }
+    // One file reached through two paths (a hard link, or a symlink the scan
+    // listed as a file): any action would remove or replace the only copy
+    std::error_code ec;
+    if (std::filesystem::equivalent(keep, dup, ec)) {
+        error = "refusing to dedupe " + dup + ": it is the same file as " + keep;
+        return false;
+    }
+    uint64_t size = 0;
+    if (!sameContents(keep, dup, size, error)) return false;
+
+    switch (action) {
+    case DedupeAction::Delete:
+        if (!std::filesystem::remove(dup, ec)) {
+            error = "cannot delete " + dup + (ec ? ": " + ec.message() : ": no such file");
+            return false;
         }
+        return true;
+    case DedupeAction::HardLink:
+        return replaceWithHardLink(keep, dup, error);
+    case DedupeAction::Reflink:
+        return shareExtents(keep, dup, size, error);
     }
+    error = "unknown dedupe action";
+    return false;
 }
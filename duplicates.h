@@ -2,10 +2,61 @@
 #define DUPLICATES_H
 
 #include "scanner.h"
+#include "hasher.h"
+#include "progress.h"
 #include <vector>
 #include <unordered_map>
+#include <cstddef>
+#include <cstdint>
 
-std::unordered_map<std::string, std::vector<FileInfo>> findDuplicates(const std::vector<FileInfo>& files);
-void handleDuplicates(std::vector<FileInfo>& files);
+// Counters for each stage of the duplicate pipeline (size -> partial -> full)
+struct DuplicateStats {
+    size_t filesConsidered = 0;
+    size_t sizeCandidates = 0;     // files sharing their size with another file
+    size_t partialHashed = 0;      // files that went through the head/tail hash
+    size_t fullHashed = 0;         // files that had to be hashed completely
+    size_t strongHashed = 0;       // files re-hashed with the strong hash
+    size_t hashesReused = 0;       // full hashes taken from the table's digests instead of disk
+    uintmax_t bytesTotal = 0;      // sum of all file sizes
+    uintmax_t bytesRead = 0;       // bytes actually read from disk
+};
+
+// Hash algorithms by makeHasher() name. The fast hash groups candidates; the
+// strong hash (empty to skip) confirms groups before anything is deleted.
+struct DuplicateOptions {
+    std::string fastHash = "xxh64";
+    std::string strongHash = "blake3";
+    ProgressCallback progress; // files through "partial-hash", "full-hash", "strong-hash"
+};
+
+// What to do with each redundant copy once a group is confirmed
+enum class DedupeAction {
+    Delete,   // remove the copy
+    HardLink, // replace the copy with a hard link to the kept file
+    Reflink   // share the kept file's extents in place (btrfs, XFS); paths, inodes
+              // and hard links stay. Fails where the filesystem has no dedupe ioctl.
+};
+
+// Groups of identical files as row ids into the searched table, keyed by
+// size and content hash. Empty files are never grouped.
+using DuplicateGroups = std::unordered_map<std::string, std::vector<FileTable::Id>>;
+
+// Digests already in the table are trusted as the fast / strong hash of the
+// file when the table names the same algorithms (FileTable::fastHashName);
+// a column filled by another algorithm, or an unnamed one, is cleared first.
+// Hashes computed here are stored back into it. Throws
+// std::invalid_argument for an unknown hash name. Each group is sorted by
+// path; its first file is the one kept.
+DuplicateGroups findDuplicates(FileTable& files, DuplicateStats* stats = nullptr,
+                               const DuplicateOptions& options = DuplicateOptions());
+
+// Apply action to dup, a copy of keep. Both files are compared byte for byte
+// first and nothing happens unless they still match. A hard link is built
+// next to dup and renamed over it, so dup's path never goes missing; a
+// reflink shares extents with dup in place. Paths that resolve to the same
+// file (hard links, symlinks) are refused for every action. On failure
+// returns false and describes the problem in error; nothing is thrown. Hard
+// links need both files on one filesystem.
+bool dedupeFile(const std::string& keep, const std::string& dup, DedupeAction action, std::string& error);
 
 #endif
@@ -0,0 +1,66 @@
+#include "entropy.h"
+#include "huffman.h"
+#include "codec.h"
+#include "mappedfile.h"
+#include <cmath>
+
+namespace {
+
+const size_t SAMPLE_WINDOW = 4096;
+const size_t SAMPLE_WINDOWS = 16;
+
+static_assert(SAMPLE_WINDOW * SAMPLE_WINDOWS == WHOLE_SAMPLE_LIMIT, "sample windows must add up to the limit");
+
+} // namespace
+
+double shannonEntropy(const uint64_t freq[256]) {
+    uint64_t total = 0;
+    for (int s = 0; s < 256; ++s) total += freq[s];
+    if (total == 0) return 0.0;
+
+    double bits = 0.0;
+    for (int s = 0; s < 256; ++s) {
+        if (freq[s] == 0) continue;
+        double p = static_cast<double>(freq[s]) / total;
+        bits -= p * std::log2(p);
+    }
+    return bits;
+}
+
+CompressionEstimate estimateCompression(const unsigned char* data, size_t size) {
+    CompressionEstimate estimate;
+    estimate.size = size;
+
+    uint64_t freq[256] = {};
+    if (size <= WHOLE_SAMPLE_LIMIT) {
+        byteHistogram(data, size, freq);
+        estimate.sampledBytes = size;
+    } else {
+        size_t stride = (size - SAMPLE_WINDOW) / (SAMPLE_WINDOWS - 1);
+        for (size_t w = 0; w < SAMPLE_WINDOWS; ++w) {
+            byteHistogram(data + w * stride, SAMPLE_WINDOW, freq);
+        }
+        estimate.sampledBytes = SAMPLE_WINDOW * SAMPLE_WINDOWS;
+    }
+
+    estimate.entropy = shannonEntropy(freq);
+    estimate.predictedSize = predictCompressedSize(freq, size);
+    return estimate;
+}
+
+void refineWithTrial(const unsigned char* data, size_t size, CompressionEstimate& estimate) {
+    CodecTrial trial = chooseCodec(data, size);
+    uint64_t trialSize = static_cast<uint64_t>(trial.ratio * size) + containerOverhead(size);
+    if (trial.codec && trial.codec->name() != std::string("huffman") && trialSize < estimate.predictedSize) {
+        estimate.predictedSize = trialSize;
+        estimate.codec = trial.codec->name();
+    }
+}
+
+bool estimateFileCompression(const std::string& path, CompressionEstimate& estimate, bool trial) {
+    MappedFile file(path, MappedFile::Random);
+    if (!file.isOpen()) return false;
+    estimate = estimateCompression(file.data(), file.size());
+    if (trial) refineWithTrial(file.data(), file.size(), estimate);
+    return true;
+}
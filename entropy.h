@@ -0,0 +1,45 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include "histogram.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// Predicted outcome of Huffman-compressing a file, from an order-0 model of
+// a sample of its bytes
+struct CompressionEstimate {
+    uint64_t size = 0;          // bytes in the file
+    uint64_t sampledBytes = 0;  // bytes the estimate was built from
+    double entropy = 8.0;       // Shannon entropy of the sample, bits per byte
+    uint64_t predictedSize = 0; // estimated .huff size with the best codec
+    std::string codec = "huffman"; // codec the prediction is for
+
+    // Predicted size over original size; 1.0 for empty files
+    double ratio() const { return size ? static_cast<double>(predictedSize) / size : 1.0; }
+};
+
+// Inputs up to this size are estimated from every byte, larger ones from
+// samples of this many bytes in total
+const size_t WHOLE_SAMPLE_LIMIT = 64 * 1024;
+
+// Bits per byte of the distribution in freq (0 for an empty histogram)
+double shannonEntropy(const uint64_t freq[256]);
+
+// Small inputs are read whole; larger ones through evenly spaced windows
+// covering the start, the end and the middle, so the cost is bounded no
+// matter how large the file is. Only a histogram is built: the prediction is
+// for Huffman, from the order-0 model.
+CompressionEstimate estimateCompression(const unsigned char* data, size_t size);
+
+// Order-0 statistics can't see repeats. This runs the other codecs on a
+// sample (chooseCodec) and keeps their prediction if it is smaller; it costs
+// a real compression of up to 64 KiB, so it is meant for the few files whose
+// histogram estimate is inconclusive, not for every file of a scan.
+void refineWithTrial(const unsigned char* data, size_t size, CompressionEstimate& estimate);
+
+// Same for a file on disk, with the codec trial if trial is set; only the
+// sampled pages are touched. False if it cannot be opened.
+bool estimateFileCompression(const std::string& path, CompressionEstimate& estimate, bool trial = false);
+
+#endif
@@ -0,0 +1,259 @@
+#include "filetable.h"
+#include "scanner.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Same rules as std::filesystem::path::extension(); "unknown" if there is none
+std::string_view typeOf(std::string_view name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0 || name == "..") return "unknown";
+    return name.substr(dot);
+}
+
+// Keep the rows whose keep[] flag is set, in order
+template <typename T>
+void compact(std::vector<T>& column, const std::vector<bool>& keep) {
+    size_t out = 0;
+    for (size_t i = 0; i < column.size(); ++i) {
+        if (keep[i]) column[out++] = std::move(column[i]);
+    }
+    column.resize(out);
+}
+
+} // namespace
+
+std::string bytesToHex(const uint8_t* bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 15];
+    }
+    return hex;
+}
+
+uint8_t hexToBytes(const std::string& hex, uint8_t* out, size_t capacity) {
+    if (hex.empty() || hex.size() % 2 != 0 || hex.size() / 2 > capacity || hex.size() / 2 > 255) return 0;
+    for (size_t i = 0; i < hex.size() / 2; ++i) {
+        int hi = hexValue(hex[2 * i]), lo = hexValue(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return 0;
+        out[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return static_cast<uint8_t>(hex.size() / 2);
+}
+
+uint64_t FileTable::store(std::string_view text) {
+    uint64_t offset = arena.size();
+    arena.append(text.data(), text.size());
+    return offset;
+}
+
+uint32_t FileTable::internType(std::string_view name) {
+    auto it = typeByName.find(std::string(name));
+    if (it != typeByName.end()) return it->second;
+    uint32_t id = static_cast<uint32_t>(types.size());
+    types.emplace_back(name);
+    typeByName.emplace(types.back(), id);
+    return id;
+}
+
+FileTable::Id FileTable::directoryFor(const std::string& path) {
+    auto it = dirByPath.find(path);
+    if (it != dirByPath.end()) return it->second;
+
+    Id parent = NONE;
+    std::string_view name = path;
+    size_t slash = path.size() >= 2 ? path.rfind('/', path.size() - 2) : std::string::npos;
+    if (slash != std::string::npos) {
+        auto p = dirByPath.find(path.substr(0, slash + 1));
+        if (p != dirByPath.end()) {
+            parent = p->second;
+            name = std::string_view(path).substr(slash + 1, path.size() - slash - 2);
+        }
+    }
+
+    Id id = static_cast<Id>(dirParent.size());
+    dirParent.push_back(parent);
+    dirNameOffset.push_back(store(name));
+    dirNameLength.push_back(static_cast<uint32_t>(name.size()));
+    dirMtime.push_back(0);
+    dirByPath.emplace(path, id);
+    return id;
+}
+
+FileTable::Id FileTable::addDirectory(const std::string& path, int64_t mtimeNs) {
+    Id id = directoryFor(path);
+    dirMtime[id] = mtimeNs;
+    return id;
+}
+
+FileTable::Id FileTable::findDirectory(const std::string& path) const {
+    auto it = dirByPath.find(path);
+    return it == dirByPath.end() ? NONE : it->second;
+}
+
+std::string FileTable::directoryPath(Id dir) const {
+    // Top-level directories hold their full '/'-terminated path, the others
+    // just their own name
+    std::vector<Id> chain;
+    for (Id d = dir; d != NONE; d = dirParent[d]) chain.push_back(d);
+
+    std::string path;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        path.append(arena, dirNameOffset[*it], dirNameLength[*it]);
+        if (dirParent[*it] != NONE) path += '/';
+    }
+    return path;
+}
+
+FileTable::Id FileTable::addFile(Id dir, std::string_view name, uint64_t size, int64_t mtimeNs, uint64_t inode,
+                                 int64_t ageDays) {
+    if (name.size() > UINT16_MAX) throw std::length_error("File name too long");
+    if (fileSize.size() >= NONE) throw std::length_error("Too many files");
+
+    Id id = static_cast<Id>(fileSize.size());
+    fileDir.push_back(dir);
+    nameOffset.push_back(store(name));
+    nameLength.push_back(static_cast<uint16_t>(name.size()));
+    fileType.push_back(internType(typeOf(name)));
+    fileSize.push_back(size);
+    fileMtime.push_back(mtimeNs);
+    fileInode.push_back(inode);
+    fileAge.push_back(static_cast<int32_t>(ageDays));
+    fastHash.emplace_back();
+    strongHash.emplace_back();
+    return id;
+}
+
+FileTable::Id FileTable::add(const FileInfo& info) {
+    size_t slash = info.path.rfind('/');
+    std::string dirPath = slash == std::string::npos ? "" : info.path.substr(0, slash + 1);
+    std::string_view name = std::string_view(info.path).substr(slash == std::string::npos ? 0 : slash + 1);
+
+    Id id = addFile(directoryFor(dirPath), name, info.size, info.mtimeNs, info.inode, info.lastModified);
+    fastHash[id].setHex(info.hash);
+    strongHash[id].setHex(info.strongHash);
+    return id;
+}
+
+FileTable FileTable::merge(std::vector<FileTable>&& shards) {
+    struct Dir {
+        std::string path;
+        size_t shard;
+        Id id;
+    };
+    std::vector<Dir> dirs;
+    size_t files = 0, bytes = 0;
+    for (size_t s = 0; s < shards.size(); ++s) {
+        for (Id d = 0; d < shards[s].directoryCount(); ++d) dirs.push_back({shards[s].directoryPath(d), s, d});
+        files += shards[s].size();
+        bytes += shards[s].arena.size();
+    }
+    std::sort(dirs.begin(), dirs.end(), [](const Dir& a, const Dir& b) { return a.path < b.path; });
+
+    FileTable out;
+    out.reserve(files);
+    out.arena.reserve(bytes);
+    std::vector<std::vector<Id>> remap(shards.size());
+    for (size_t s = 0; s < shards.size(); ++s) remap[s].resize(shards[s].directoryCount());
+    for (const Dir& d : dirs) remap[d.shard][d.id] = out.addDirectory(d.path, shards[d.shard].dirMtime[d.id]);
+
+    for (size_t s = 0; s < shards.size(); ++s) {
+        FileTable& shard = shards[s];
+        for (Id i = 0; i < shard.size(); ++i) {
+            Id id = out.addFile(remap[s][shard.fileDir[i]], shard.name(i), shard.fileSize[i], shard.fileMtime[i],
+                                shard.fileInode[i], shard.fileAge[i]);
+            out.fastHash[id] = shard.fastHash[i];
+            out.strongHash[id] = shard.strongHash[i];
+        }
+        shard = FileTable(); // release as we go
+    }
+    return out;
+}
+
+void FileTable::erase(std::vector<Id> ids) {
+    if (ids.empty()) return;
+    std::vector<bool> keep(size(), true);
+    for (Id id : ids) {
+        if (id < keep.size()) keep[id] = false;
+    }
+
+    // Names stay in the arena; it is append-only
+    compact(fileDir, keep);
+    compact(nameOffset, keep);
+    compact(nameLength, keep);
+    compact(fileType, keep);
+    compact(fileSize, keep);
+    compact(fileMtime, keep);
+    compact(fileInode, keep);
+    compact(fileAge, keep);
+    compact(fastHash, keep);
+    compact(strongHash, keep);
+}
+
+void FileTable::setHashNames(const std::string& fast, const std::string& strong) {
+    fastName = fast;
+    strongName = strong;
+}
+
+void FileTable::resetFastDigests(const std::string& name) {
+    std::fill(fastHash.begin(), fastHash.end(), Digest<16>());
+    fastName = name;
+}
+
+void FileTable::resetStrongDigests(const std::string& name) {
+    std::fill(strongHash.begin(), strongHash.end(), Digest<32>());
+    strongName = name;
+}
+
+void FileTable::reserve(size_t files) {
+    fileDir.reserve(files);
+    nameOffset.reserve(files);
+    nameLength.reserve(files);
+    fileType.reserve(files);
+    fileSize.reserve(files);
+    fileMtime.reserve(files);
+    fileInode.reserve(files);
+    fileAge.reserve(files);
+    fastHash.reserve(files);
+    strongHash.reserve(files);
+}
+
+std::string FileTable::path(Id id) const {
+    std::string path = directoryPath(fileDir[id]);
+    path.append(arena, nameOffset[id], nameLength[id]);
+    return path;
+}
+
+void FileTable::rename(Id id, std::string_view name) {
+    if (name.size() > UINT16_MAX) throw std::length_error("File name too long");
+    nameOffset[id] = store(name);
+    nameLength[id] = static_cast<uint16_t>(name.size());
+    fileType[id] = internType(typeOf(name));
+}
+
+FileInfo FileTable::info(Id id) const {
+    FileInfo info;
+    info.name = std::string(name(id));
+    info.path = path(id);
+    info.size = fileSize[id];
+    info.lastModified = fileAge[id];
+    info.type = std::string(type(id));
+    info.hash = fastHash[id].hex();
+    info.strongHash = strongHash[id].hex();
+    info.inode = fileInode[id];
+    info.mtimeNs = fileMtime[id];
+    return info;
+}
+
+FileInfo FileTable::Ref::info() const {
+    return table->info(index);
+}
@@ -0,0 +1,192 @@
+#ifndef FILETABLE_H
+#define FILETABLE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+struct FileInfo;
+
+// Lowercase hex <-> bytes. hexToBytes returns the byte count, or 0 if the
+// digest isn't hex or doesn't fit in capacity.
+std::string bytesToHex(const uint8_t* bytes, size_t size);
+uint8_t hexToBytes(const std::string& hex, uint8_t* out, size_t capacity);
+
+// Content digest stored inline; length 0 means not computed
+template <size_t N>
+struct Digest {
+    uint8_t length = 0;
+    uint8_t bytes[N] = {};
+
+    bool empty() const { return length == 0; }
+    std::string hex() const { return bytesToHex(bytes, length); }
+    void setHex(const std::string& hex) { length = hexToBytes(hex, bytes, N); }
+};
+
+// Column-oriented table of scanned files. A file is a row of fixed-size
+// columns (directory id, size, mtime, inode, interned extension id, inline
+// digests); names live in one string arena and directories are stored once
+// as parent id + name, so a path costs its last component. Rows are viewed
+// through FileTable::Ref, which is two words and copies nothing.
+//
+// The table is move-only so it is never duplicated by accident; hand out
+// Refs or Ids instead. Ids are dense and stay valid until erase().
+class FileTable {
+public:
+    using Id = uint32_t;
+    static constexpr Id NONE = UINT32_MAX;
+
+    class Ref;
+    class Iterator;
+
+    FileTable() = default;
+    FileTable(FileTable&&) noexcept = default;
+    FileTable& operator=(FileTable&&) noexcept = default;
+    FileTable(const FileTable&) = delete;
+    FileTable& operator=(const FileTable&) = delete;
+
+    // Directory by '/'-terminated path, created if new (the mtime is updated
+    // either way). It is linked to its parent when the parent is already in
+    // the table, otherwise it keeps its full path as its name.
+    Id addDirectory(const std::string& path, int64_t mtimeNs = 0);
+    Id findDirectory(const std::string& path) const;
+    size_t directoryCount() const { return dirParent.size(); }
+    std::string directoryPath(Id dir) const;
+    int64_t directoryMtime(Id dir) const { return dirMtime[dir]; }
+
+    Id addFile(Id dir, std::string_view name, uint64_t size, int64_t mtimeNs, uint64_t inode, int64_t ageDays);
+    Id add(const FileInfo& info);
+
+    // One table from several built independently (e.g. per scan worker).
+    // Directories are added in path order so each finds its parent.
+    static FileTable merge(std::vector<FileTable>&& shards);
+
+    // Remove rows; the remaining rows keep their order and are renumbered
+    void erase(std::vector<Id> ids);
+    void reserve(size_t files);
+
+    size_t size() const { return fileSize.size(); }
+    bool empty() const { return fileSize.empty(); }
+    Ref operator[](Id id) const;
+    Iterator begin() const;
+    Iterator end() const;
+
+    Id directoryOf(Id id) const { return fileDir[id]; }
+    std::string path(Id id) const;
+    std::string_view name(Id id) const { return std::string_view(arena).substr(nameOffset[id], nameLength[id]); }
+    std::string_view type(Id id) const { return types[fileType[id]]; }
+    uint32_t typeId(Id id) const { return fileType[id]; }
+    uint64_t sizeOf(Id id) const { return fileSize[id]; }
+    int64_t mtimeNs(Id id) const { return fileMtime[id]; }
+    uint64_t inode(Id id) const { return fileInode[id]; }
+    int64_t lastModified(Id id) const { return fileAge[id]; }
+    FileInfo info(Id id) const;
+
+    // Whole columns, for passes that only need one field
+    const std::vector<uint64_t>& sizes() const { return fileSize; }
+
+    Digest<16>& fastDigest(Id id) { return fastHash[id]; }
+    const Digest<16>& fastDigest(Id id) const { return fastHash[id]; }
+    Digest<32>& strongDigest(Id id) { return strongHash[id]; }
+    const Digest<32>& strongDigest(Id id) const { return strongHash[id]; }
+
+    // makeHasher() names of the algorithms behind the digest columns, "" when
+    // unknown. Whoever fills a column names it; digests under another name
+    // are not comparable and must not be trusted.
+    const std::string& fastHashName() const { return fastName; }
+    const std::string& strongHashName() const { return strongName; }
+    void setHashNames(const std::string& fast, const std::string& strong);
+
+    // Clear a digest column and name it for the digests computed from now on
+    void resetFastDigests(const std::string& name);
+    void resetStrongDigests(const std::string& name);
+
+    // Point a row at a new name in the same directory (e.g. after compression)
+    void rename(Id id, std::string_view name);
+    void setSize(Id id, uint64_t size) { fileSize[id] = size; }
+
+private:
+    std::string arena;
+
+    std::vector<Id> dirParent;
+    std::vector<uint64_t> dirNameOffset;
+    std::vector<uint32_t> dirNameLength;
+    std::vector<int64_t> dirMtime;
+    std::unordered_map<std::string, Id> dirByPath;
+
+    std::vector<Id> fileDir;
+    std::vector<uint64_t> nameOffset;
+    std::vector<uint16_t> nameLength;
+    std::vector<uint32_t> fileType;
+    std::vector<uint64_t> fileSize;
+    std::vector<int64_t> fileMtime;
+    std::vector<uint64_t> fileInode;
+    std::vector<int32_t> fileAge;
+    std::vector<Digest<16>> fastHash;
+    std::vector<Digest<32>> strongHash;
+    std::string fastName;
+    std::string strongName;
+
+    std::vector<std::string> types;
+    std::unordered_map<std::string, uint32_t> typeByName;
+
+    Id directoryFor(const std::string& path);
+    uint64_t store(std::string_view text);
+    uint32_t internType(std::string_view name);
+};
+
+// Read-only view of one row
+class FileTable::Ref {
+public:
+    Ref(const FileTable* table, Id id) : table(table), index(id) {}
+
+    Id id() const { return index; }
+    std::string path() const { return table->path(index); }
+    std::string_view name() const { return table->name(index); }
+    std::string_view type() const { return table->type(index); }
+    uint64_t size() const { return table->sizeOf(index); }
+    int64_t mtimeNs() const { return table->mtimeNs(index); }
+    uint64_t inode() const { return table->inode(index); }
+    int64_t lastModified() const { return table->lastModified(index); }
+    std::string hash() const { return table->fastDigest(index).hex(); }
+    std::string strongHash() const { return table->strongDigest(index).hex(); }
+    FileInfo info() const;
+
+private:
+    const FileTable* table;
+    Id index;
+};
+
+class FileTable::Iterator {
+public:
+    Iterator(const FileTable* table, Id id) : table(table), index(id) {}
+
+    Ref operator*() const { return Ref(table, index); }
+    Iterator& operator++() {
+        ++index;
+        return *this;
+    }
+    bool operator!=(const Iterator& other) const { return index != other.index; }
+    bool operator==(const Iterator& other) const { return index == other.index; }
+
+private:
+    const FileTable* table;
+    Id index;
+};
+
+inline FileTable::Ref FileTable::operator[](Id id) const {
+    return Ref(this, id);
+}
+
+inline FileTable::Iterator FileTable::begin() const {
+    return Iterator(this, 0);
+}
+
+inline FileTable::Iterator FileTable::end() const {
+    return Iterator(this, static_cast<Id>(size()));
+}
+
+#endif
@@ -0,0 +1,146 @@
+#include "hasher.h"
+#include "blake3.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+std::string toHex(const unsigned char* bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[2 * i] = digits[bytes[i] >> 4];
+        hex[2 * i + 1] = digits[bytes[i] & 15];
+    }
+    return hex;
+}
+
+std::string toHex64(uint64_t value) {
+    char hexStr[17];
+    snprintf(hexStr, sizeof(hexStr), "%016llx", static_cast<unsigned long long>(value));
+    return std::string(hexStr);
+}
+
+class Poly31Hasher : public Hasher {
+public:
+    const char* name() const override { return "poly31"; }
+
+    std::string hash(const unsigned char* data, size_t size) const override {
+        unsigned long long hash = 0;
+        for (size_t i = 0; i < size; ++i) hash = hash * 31 + data[i];
+        return toHex64(hash);
+    }
+};
+
+// XXH64: four independent 64-bit lanes over 32-byte stripes, so the
+// multiply chains overlap instead of serialising on one accumulator.
+class Xxh64Hasher : public Hasher {
+public:
+    const char* name() const override { return "xxh64"; }
+
+    std::string hash(const unsigned char* data, size_t size) const override {
+        return toHex64(xxh64(data, size, 0));
+    }
+
+private:
+    static const uint64_t P1 = 11400714785074694791ULL;
+    static const uint64_t P2 = 14029467366897019727ULL;
+    static const uint64_t P3 = 1609587929392839161ULL;
+    static const uint64_t P4 = 9650029242287828579ULL;
+    static const uint64_t P5 = 2870177450012600261ULL;
+
+    static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    static uint64_t read64(const unsigned char* p) {
+        uint64_t v = 0;
+        for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+        return v;
+    }
+
+    static uint32_t read32(const unsigned char* p) {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+
+    static uint64_t round(uint64_t acc, uint64_t input) {
+        acc += input * P2;
+        acc = rotl(acc, 31);
+        return acc * P1;
+    }
+
+    static uint64_t mergeRound(uint64_t acc, uint64_t value) {
+        acc ^= round(0, value);
+        return acc * P1 + P4;
+    }
+
+    static uint64_t xxh64(const unsigned char* p, size_t size, uint64_t seed) {
+        const unsigned char* end = p + size;
+        uint64_t h;
+
+        if (size >= 32) {
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            const unsigned char* limit = end - 32;
+            do {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = mergeRound(h, v1);
+            h = mergeRound(h, v2);
+            h = mergeRound(h, v3);
+            h = mergeRound(h, v4);
+        } else {
+            h = seed + P5;
+        }
+
+        h += size;
+        for (; p + 8 <= end; p += 8) {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * P1 + P4;
+        }
+        if (p + 4 <= end) {
+            h ^= uint64_t(read32(p)) * P1;
+            h = rotl(h, 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; ++p) {
+            h ^= *p * P5;
+            h = rotl(h, 11) * P1;
+        }
+
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+class Blake3Hasher : public Hasher {
+public:
+    const char* name() const override { return "blake3"; }
+
+    std::string hash(const unsigned char* data, size_t size) const override {
+        unsigned char digest[BLAKE3_OUT_LEN];
+        blake3Hash(data, size, digest);
+        return toHex(digest, sizeof(digest));
+    }
+};
+
+} // namespace
+
+std::unique_ptr<Hasher> makeHasher(const std::string& name) {
+    if (name == "xxh64") return std::make_unique<Xxh64Hasher>();
+    if (name == "blake3") return std::make_unique<Blake3Hasher>();
+    if (name == "poly31") return std::make_unique<Poly31Hasher>();
+    return nullptr;
+}
+
+std::vector<std::string> hasherNames() {
+    return {"xxh64", "blake3", "poly31"};
+}
@@ -0,0 +1,26 @@
+#ifndef HASHER_H
+#define HASHER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Content hash used by the duplicate finder. Digests are lowercase hex.
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+
+    virtual const char* name() const = 0;
+    virtual std::string hash(const unsigned char* data, size_t size) const = 0;
+};
+
+// Available algorithms:
+//   "xxh64"  - fast 64-bit non-cryptographic hash (candidate grouping)
+//   "blake3" - 256-bit cryptographic hash, tree-parallel on large inputs
+//   "poly31" - the original hash*31 polynomial, kept for comparison
+// Returns nullptr for an unknown name.
+std::unique_ptr<Hasher> makeHasher(const std::string& name);
+std::vector<std::string> hasherNames();
+
+#endif
@@ -0,0 +1,89 @@
+#include "histogram.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define HISTOGRAM_HAVE_AVX2 1
+#endif
+
+namespace {
+
+// Every kernel counts into interleaved 32-bit tables, so consecutive equal
+// bytes hit different counters instead of waiting on each other's
+// increment. Input is fed in slices short enough that no counter can wrap
+// before the tables are folded into the 64-bit result.
+const size_t SLICE = size_t(1) << 30;
+
+template <int TABLES>
+void fold(uint32_t (&counts)[TABLES][256], uint64_t freq[256]) {
+    for (int s = 0; s < 256; ++s) {
+        uint64_t total = 0;
+        for (int t = 0; t < TABLES; ++t) total += counts[t][s];
+        freq[s] += total;
+    }
+}
+
+// Portable kernel: one 64-bit load per 8 bytes, bytes peeled off with shifts
+// (byte order doesn't matter for counting)
+void histogramWords(const unsigned char* data, size_t size, uint64_t freq[256]) {
+    uint32_t counts[4][256] = {};
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, data + i, 8);
+        counts[0][w & 0xff]++;
+        counts[1][(w >> 8) & 0xff]++;
+        counts[2][(w >> 16) & 0xff]++;
+        counts[3][(w >> 24) & 0xff]++;
+        counts[0][(w >> 32) & 0xff]++;
+        counts[1][(w >> 40) & 0xff]++;
+        counts[2][(w >> 48) & 0xff]++;
+        counts[3][w >> 56]++;
+    }
+    for (; i < size; ++i) counts[0][data[i]]++;
+    fold(counts, freq);
+}
+
+#ifdef HISTOGRAM_HAVE_AVX2
+// 32 bytes per iteration spread over eight tables. There is no byte scatter
+// to vectorize the increments themselves, so the vector unit only does the
+// wide load and the lane extraction.
+__attribute__((target("avx2")))
+void histogramAvx2(const unsigned char* data, size_t size, uint64_t freq[256]) {
+    uint32_t counts[8][256] = {};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint64_t w[4] = {static_cast<uint64_t>(_mm256_extract_epi64(v, 0)),
+                         static_cast<uint64_t>(_mm256_extract_epi64(v, 1)),
+                         static_cast<uint64_t>(_mm256_extract_epi64(v, 2)),
+                         static_cast<uint64_t>(_mm256_extract_epi64(v, 3))};
+        for (int j = 0; j < 4; ++j) {
+            counts[0][w[j] & 0xff]++;
+            counts[1][(w[j] >> 8) & 0xff]++;
+            counts[2][(w[j] >> 16) & 0xff]++;
+            counts[3][(w[j] >> 24) & 0xff]++;
+            counts[4][(w[j] >> 32) & 0xff]++;
+            counts[5][(w[j] >> 40) & 0xff]++;
+            counts[6][(w[j] >> 48) & 0xff]++;
+            counts[7][w[j] >> 56]++;
+        }
+    }
+    for (; i < size; ++i) counts[i & 7][data[i]]++;
+    fold(counts, freq);
+}
+#endif
+
+} // namespace
+
+void byteHistogram(const unsigned char* data, size_t size, uint64_t freq[256]) {
+    void (*kernel)(const unsigned char*, size_t, uint64_t*) = histogramWords;
+#ifdef HISTOGRAM_HAVE_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) kernel = histogramAvx2;
+#endif
+    for (size_t done = 0; done < size; done += SLICE) {
+        kernel(data + done, std::min(SLICE, size - done), freq);
+    }
+}
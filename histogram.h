@@ -0,0 +1,12 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Add the byte counts of data to freq. Counts are 64-bit, so inputs of any
+// size are safe. Uses an AVX2 kernel when the CPU has it, a portable
+// word-at-a-time kernel otherwise.
+void byteHistogram(const unsigned char* data, size_t size, uint64_t freq[256]);
+
+#endif
@@ -1,134 +1,922 @@
-#include "huffman.h"
-#include <iostream>
-#include <fstream>
-#include <queue>
-#include <unordered_map>
-#include <vector>
-
-struct Node {
-    char ch;
-    int freq;
-    Node* left = nullptr;
-    Node* right = nullptr;
-    Node(char c, int f) : ch(c), freq(f) {}
-};
-
-struct Compare {
-    bool operator()(Node* a, Node* b) {
-        return a->freq > b->freq;
-    }
-};
-
-Node* buildTree(std::unordered_map<char, int>& freq) {
-    std::priority_queue<Node*, std::vector<Node*>, Compare> pq;
-    for (const auto& p : freq) {
-        pq.push(new Node(p.first, p.second));
-    }
-    while (pq.size() > 1) {
-        Node* left = pq.top(); pq.pop();
-        Node* right = pq.top(); pq.pop();
-        Node* parent = new Node('\0', left->freq + right->freq);
-        parent->left = left; parent->right = right;
-        pq.push(parent);
-    }
-    return pq.top();
-}
-
-void generateCodes(Node* root, const std::string& code, std::unordered_map<char, std::string>& codes) {
-    if (!root) return;
-    if (!root->left && !root->right) {
-        codes[root->ch] = code.empty() ? "0" : code;
-    } else {
-        generateCodes(root->left, code + "0", codes);
-        generateCodes(root->right, code + "1", codes);
-    }
-}
-
-void writeCompressedData(std::ifstream& in, const std::unordered_map<char, std::string>& codes, std::ofstream& out) {
-    std::string buffer;
-    char ch;
-    while (in.get(ch)) {
-        buffer += codes.at(ch);
-        while (buffer.length() >= 8) {
-            unsigned char byte = 0;
-            for (int i = 0; i < 8; ++i) {
-                if (buffer[i] == '1') byte |= (1 << (7 - i));
-            }
-            out.put(byte);
-            buffer = buffer.substr(8);
-        }
-    }
-    if (!buffer.empty()) {
-        buffer.append(8 - buffer.length(), '0');
-        unsigned char byte = 0;
-        for (int i = 0; i < 8; ++i) {
-            if (buffer[i] == '1') byte |= (1 << (7 - i));
-        }
-        out.put(byte);
-    }
-}
-
-void compressFile(const std::string& inputFile, const std::string& outputFile) {
-    std::ifstream in(inputFile);
-    std::unordered_map<char, int> freq;
-    char ch;
-    while (in.get(ch)) freq[ch]++;
-    in.close();
-
-    Node* root = buildTree(freq);
-    std::unordered_map<char, std::string> codes;
-    generateCodes(root, "", codes);
-
-    std::ofstream out(outputFile, std::ios::binary);
-    int mapSize = freq.size();
-    out.write(reinterpret_cast<char*>(&mapSize), sizeof(int));
-    for (const auto& p : freq) {
-        out.write(&p.first, sizeof(char));
-        out.write(reinterpret_cast<const char*>(&p.second), sizeof(int));
-    }
-
-    in.open(inputFile);
-    writeCompressedData(in, codes, out);
-    in.close();
-    out.close();
-    std::cout << "File compressed to " << outputFile << std::endl;
-}
-
-void decompressFile(const std::string& inputFile, const std::string& outputFile) {
-    std::ifstream in(inputFile, std::ios::binary);
-    std::unordered_map<char, int> freq;
-
-    int mapSize;
-    in.read(reinterpret_cast<char*>(&mapSize), sizeof(int));
-    for (int i = 0; i < mapSize; ++i) {
-        char ch;
-        int f;
-        in.read(&ch, sizeof(char));
-        in.read(reinterpret_cast<char*>(&f), sizeof(int));
-        freq[ch] = f;
-    }
-
-    Node* root = buildTree(freq);
-
-    int totalChars = 0;
-    for (const auto& p : freq) totalChars += p.second;
-
-    std::ofstream out(outputFile);
-    Node* current = root;
-    unsigned char byte;
-    int decodedChars = 0;
-
-    while (in.read(reinterpret_cast<char*>(&byte), 1) && decodedChars < totalChars) {
-        for (int i = 7; i >= 0 && decodedChars < totalChars; --i) {
-            current = (byte >> i) & 1 ? current->right : current->left;
-            if (!current->left && !current->right) {
-                out.put(current->ch);
-                decodedChars++;
-                current = root;
-            }
-        }
-    }
-    in.close();
-    out.close();
-    std::cout << "File decompressed to " << outputFile << std::endl;
-}
+#include "huffman.h"
+#include "crc32c.h"
+#include "threadpool.h"
+#include "mappedfile.h"
+#include "histogram.h"
+#include "codec.h"
+#include "instrument.h"
+#include <chrono>
+#include <mutex>
+#include <exception>
+#include <memory>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+void buildTree(const uint64_t freq[256], HuffmanTree& tree) {
+    HuffmanTree::Node* nodes = tree.nodes;
+    int n = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (freq[s]) nodes[n++] = {freq[s], -1, -1, static_cast<uint8_t>(s)};
+    }
+    // Ties broken by symbol so the tree is deterministic
+    std::sort(nodes, nodes + n, [](const HuffmanTree::Node& a, const HuffmanTree::Node& b) {
+        return a.freq != b.freq ? a.freq < b.freq : a.symbol < b.symbol;
+    });
+    tree.leaves = tree.count = n;
+
+    // Two queues, both already in frequency order: the sorted leaves and the
+    // merged nodes, which come out no lighter than the ones before them. The
+    // two lightest are always at the queue fronts, so each merge is O(1).
+    // Leaves win ties, which keeps the longest code short.
+    int leaf = 0, merged = n;
+    auto lightest = [&]() -> int16_t {
+        if (leaf < n && (merged == tree.count || nodes[leaf].freq <= nodes[merged].freq)) return leaf++;
+        return merged++;
+    };
+    for (int m = 1; m < n; ++m) {
+        int16_t left = lightest();
+        int16_t right = lightest();
+        nodes[tree.count++] = {nodes[left].freq + nodes[right].freq, left, right, 0};
+    }
+}
+
+void generateCodeLengths(const HuffmanTree& tree, uint8_t lengths[256]) {
+    std::fill(lengths, lengths + 256, 0);
+    if (tree.count == 0) return;
+
+    // Parents come after their children, so one backward pass from the root
+    // gives every node its depth
+    uint8_t depth[HuffmanTree::MAX_NODES];
+    depth[tree.count - 1] = 0;
+    for (int i = tree.count - 1; i >= tree.leaves; --i) {
+        depth[tree.nodes[i].left] = depth[tree.nodes[i].right] = static_cast<uint8_t>(depth[i] + 1);
+    }
+    for (int i = 0; i < tree.leaves; ++i) {
+        lengths[tree.nodes[i].symbol] = tree.leaves == 1 ? 1 : depth[i];
+    }
+}
+
+// Canonical codes: sorted by (length, symbol), consecutive values per length
+void buildCanonicalCodes(const uint8_t lengths[256], HuffCode codes[256]) {
+    int count[MAX_CODE_LENGTH + 1] = {};
+    for (int s = 0; s < 256; ++s) {
+        if (lengths[s] > MAX_CODE_LENGTH) throw std::runtime_error("Huffman code too long");
+        count[lengths[s]]++;
+    }
+    count[0] = 0;
+
+    uint64_t next[MAX_CODE_LENGTH + 1] = {};
+    uint64_t code = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; ++len) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+
+    for (int s = 0; s < 256; ++s) {
+        codes[s].length = lengths[s];
+        codes[s].bits = lengths[s] ? next[lengths[s]]++ : 0;
+    }
+}
+
+namespace {
+
+// Container layout, all integers little-endian:
+//   header   "SMHF", u8 version, u8 flags, u16 reserved, u32 block size,
+//            u32 reserved, u64 original size (0 if FLAG_STREAMED)
+//   blocks   u32 raw size, u32 payload size, u32 CRC32C of the raw bytes,
+//            u8 codec id, u8 reserved, u16 table size, codec table, payload
+//   end      a block header with raw and payload size 0
+//   index    per block: u64 file offset, u32 raw size, u32 stored size
+//   trailer  u64 index offset, u64 block count, u64 original size,
+//            u32 CRC32C of the index, "SMHI"
+// The Huffman codec's table holds code lengths: either 256 one-byte lengths
+// or, when shorter, (symbol, length) pairs for the symbols that occur.
+const char FILE_MAGIC[4] = {'S', 'M', 'H', 'F'};
+const char INDEX_MAGIC[4] = {'S', 'M', 'H', 'I'};
+const uint8_t FORMAT_VERSION = 1;
+const uint8_t FLAG_STREAMED = 1; // written without knowing the size; the header says 0
+const size_t HEADER_SIZE = 24;
+const size_t BLOCK_HEADER_SIZE = 16;
+const size_t INDEX_ENTRY_SIZE = 16;
+const size_t TRAILER_SIZE = 32;
+const uint32_t MIN_BLOCK_SIZE = 4096;
+const uint32_t MAX_BLOCK_SIZE = 64u << 20;
+const uint32_t MAX_TABLE_SIZE = 256; // the dense code length table; no codec's is larger
+
+void putLE(std::vector<unsigned char>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+
+void putLE(unsigned char* p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = static_cast<unsigned char>(value >> (8 * i));
+}
+
+uint64_t getLE(const unsigned char* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) value = (value << 8) | p[i];
+    return value;
+}
+
+struct BlockHeader {
+    uint32_t rawSize = 0;
+    uint32_t payloadSize = 0;
+    uint32_t crc = 0;
+    uint8_t codec = 0;
+    uint16_t tableSize = 0;
+};
+
+void packBlockHeader(unsigned char* p, const BlockHeader& h) {
+    putLE(p, h.rawSize, 4);
+    putLE(p + 4, h.payloadSize, 4);
+    putLE(p + 8, h.crc, 4);
+    p[12] = h.codec;
+    p[13] = 0;
+    putLE(p + 14, h.tableSize, 2);
+}
+
+void writeBlockHeader(std::vector<unsigned char>& out, const BlockHeader& h) {
+    unsigned char packed[BLOCK_HEADER_SIZE];
+    packBlockHeader(packed, h);
+    out.insert(out.end(), packed, packed + BLOCK_HEADER_SIZE);
+}
+
+BlockHeader readBlockHeader(const unsigned char* p) {
+    BlockHeader h;
+    h.rawSize = static_cast<uint32_t>(getLE(p, 4));
+    h.payloadSize = static_cast<uint32_t>(getLE(p + 4, 4));
+    h.crc = static_cast<uint32_t>(getLE(p + 8, 4));
+    h.codec = p[12];
+    h.tableSize = static_cast<uint16_t>(getLE(p + 14, 2));
+    return h;
+}
+
+// encodeBlock stores a block raw rather than let it grow, so table and
+// payload never exceed the raw size by more than a table. Checked before
+// anything is allocated for the stored bytes.
+bool plausibleBlock(const BlockHeader& h, uint32_t blockSize) {
+    return h.rawSize <= blockSize && h.tableSize <= MAX_TABLE_SIZE &&
+           h.tableSize + uint64_t(h.payloadSize) <= uint64_t(h.rawSize) + MAX_TABLE_SIZE;
+}
+
+void readExact(std::istream& in, void* data, size_t size) {
+    in.read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+    if (static_cast<size_t>(in.gcount()) != size) throw std::runtime_error("Truncated .huff file");
+}
+
+struct IndexEntry {
+    uint64_t fileOffset;
+    uint64_t rawOffset; // position of the block's first byte in the original file
+    uint32_t rawSize;
+    uint32_t storedSize;
+};
+
+// Load the block index through the trailer at the end of the file; raw is
+// scratch space for the stored entries
+void readIndex(std::ifstream& in, uint64_t& originalSize, std::vector<IndexEntry>& index,
+               std::vector<unsigned char>& raw) {
+    in.seekg(0, std::ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    if (fileSize < HEADER_SIZE + BLOCK_HEADER_SIZE + TRAILER_SIZE) throw std::runtime_error("Truncated .huff file");
+
+    unsigned char trailer[TRAILER_SIZE];
+    in.seekg(static_cast<std::streamoff>(fileSize - TRAILER_SIZE));
+    readExact(in, trailer, TRAILER_SIZE);
+    if (!std::equal(INDEX_MAGIC, INDEX_MAGIC + 4, trailer + 28)) throw std::runtime_error("Missing .huff block index");
+
+    uint64_t indexOffset = getLE(trailer, 8);
+    uint64_t blockCount = getLE(trailer + 8, 8);
+    originalSize = getLE(trailer + 16, 8);
+    uint32_t indexCrc = static_cast<uint32_t>(getLE(trailer + 24, 4));
+    if (indexOffset > fileSize - TRAILER_SIZE ||
+        blockCount != (fileSize - TRAILER_SIZE - indexOffset) / INDEX_ENTRY_SIZE) {
+        throw std::runtime_error("Corrupt .huff block index");
+    }
+
+    raw.resize(blockCount * INDEX_ENTRY_SIZE);
+    in.seekg(static_cast<std::streamoff>(indexOffset));
+    readExact(in, raw.data(), raw.size());
+    if (crc32c(0, raw.data(), raw.size()) != indexCrc) throw std::runtime_error("CRC mismatch in .huff block index");
+
+    index.resize(blockCount);
+    uint64_t rawOffset = 0;
+    for (uint64_t i = 0; i < blockCount; ++i) {
+        const unsigned char* p = raw.data() + i * INDEX_ENTRY_SIZE;
+        index[i].fileOffset = getLE(p, 8);
+        index[i].rawOffset = rawOffset;
+        index[i].rawSize = static_cast<uint32_t>(getLE(p + 8, 4));
+        index[i].storedSize = static_cast<uint32_t>(getLE(p + 12, 4));
+        rawOffset += index[i].rawSize;
+    }
+    if (rawOffset != originalSize) throw std::runtime_error("Corrupt .huff block index");
+}
+
+// MSB-first bit writer: codes go into a 64-bit accumulator that is drained
+// 32 bits at a time into the output byte vector.
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    void put(uint64_t bits, int length) {
+        if (length > 32) {
+            put(bits >> 32, length - 32);
+            bits &= 0xffffffffu;
+            length = 32;
+        }
+        acc = (acc << length) | bits;
+        count += length;
+        if (count >= 32) {
+            count -= 32;
+            uint32_t word = static_cast<uint32_t>(acc >> count);
+            unsigned char bytes[4] = {static_cast<unsigned char>(word >> 24), static_cast<unsigned char>(word >> 16),
+                                      static_cast<unsigned char>(word >> 8), static_cast<unsigned char>(word)};
+            out.insert(out.end(), bytes, bytes + 4);
+        }
+    }
+
+    // Pad the last partial byte with zeros
+    void finish() {
+        while (count >= 8) {
+            count -= 8;
+            out.push_back(static_cast<unsigned char>(acc >> count));
+        }
+        if (count > 0) {
+            out.push_back(static_cast<unsigned char>(acc << (8 - count)));
+            count = 0;
+        }
+    }
+
+private:
+    std::vector<unsigned char>& out;
+    uint64_t acc = 0;
+    int count = 0;
+};
+
+// MSB-first bit reader over an in-memory payload. Past the end it yields
+// zero bits; callers stop on the decoded symbol count.
+class BitReader {
+public:
+    BitReader(const unsigned char* data, size_t size) : pos(data), end(data + size) {}
+
+    // Make at least 57 bits available
+    void refill() {
+        if (end - pos >= 8) {
+            uint64_t word = 0;
+            for (int i = 0; i < 8; ++i) word = (word << 8) | pos[i];
+            acc |= word >> count;
+            pos += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count <= 56) {
+            if (pos == end) {
+                count = 64; // zero padding
+                return;
+            }
+            acc |= static_cast<uint64_t>(*pos++) << (56 - count);
+            count += 8;
+        }
+    }
+
+    int available() const { return count; }
+    uint64_t peek(int n) const { return acc >> (64 - n); }
+    void consume(int n) { acc <<= n; count -= n; }
+
+private:
+    const unsigned char* pos;
+    const unsigned char* end;
+    uint64_t acc = 0; // valid bits are left-aligned
+    int count = 0;
+};
+
+// Canonical Huffman decoder. Codes up to PRIMARY_BITS long are resolved with a
+// single probe of a 2^PRIMARY_BITS table; longer (rare) codes overflow into a
+// per-length canonical search.
+class TableDecoder {
+public:
+    static const int PRIMARY_BITS = 11;
+
+    explicit TableDecoder(const uint8_t lengths[256]) {
+        int count[MAX_CODE_LENGTH + 1] = {};
+        for (int s = 0; s < 256; ++s) count[lengths[s]]++;
+        count[0] = 0;
+
+        // Symbols sorted by (length, symbol), plus first code and offset per length
+        int offset = 0;
+        uint64_t code = 0;
+        for (int len = 1; len <= MAX_CODE_LENGTH; ++len) {
+            code = (code + (len > 1 ? count[len - 1] : 0)) << 1;
+            firstCode[len] = code;
+            firstIndex[len] = offset;
+            countPerLength[len] = count[len];
+            offset += count[len];
+            if (count[len]) maxLength = len;
+        }
+        int next = 0;
+        for (int len = 1; len <= MAX_CODE_LENGTH; ++len) {
+            for (int s = 0; s < 256; ++s) {
+                if (lengths[s] == len) sorted[next++] = static_cast<unsigned char>(s);
+            }
+        }
+
+        HuffCode codes[256];
+        buildCanonicalCodes(lengths, codes);
+        for (auto& e : primary) e = {0, 0};
+        for (int s = 0; s < 256; ++s) {
+            int len = codes[s].length;
+            if (len == 0 || len > PRIMARY_BITS) continue;
+            uint32_t first = static_cast<uint32_t>(codes[s].bits) << (PRIMARY_BITS - len);
+            uint32_t span = 1u << (PRIMARY_BITS - len);
+            for (uint32_t i = 0; i < span; ++i) {
+                primary[first + i] = {static_cast<uint8_t>(s), static_cast<uint8_t>(len)};
+            }
+        }
+    }
+
+    int longestCode() const { return maxLength; }
+
+    // Decode one symbol; the reader must hold at least longestCode() bits
+    unsigned char decode(BitReader& reader) const {
+        const Entry& e = primary[reader.peek(PRIMARY_BITS)];
+        if (e.length) {
+            reader.consume(e.length);
+            return e.symbol;
+        }
+        for (int len = PRIMARY_BITS + 1; len <= maxLength; ++len) {
+            uint64_t code = reader.peek(len);
+            if (code - firstCode[len] < static_cast<uint64_t>(countPerLength[len])) {
+                reader.consume(len);
+                return sorted[firstIndex[len] + (code - firstCode[len])];
+            }
+        }
+        throw std::runtime_error("Corrupt Huffman stream");
+    }
+
+private:
+    struct Entry {
+        uint8_t symbol;
+        uint8_t length; // 0 = code longer than PRIMARY_BITS
+    };
+
+    Entry primary[1 << PRIMARY_BITS];
+    uint64_t firstCode[MAX_CODE_LENGTH + 1] = {};
+    int firstIndex[MAX_CODE_LENGTH + 1] = {};
+    int countPerLength[MAX_CODE_LENGTH + 1] = {};
+    int maxLength = 0;
+    unsigned char sorted[256];
+};
+
+} // namespace
+
+// Kraft inequality: lengths read from a file must describe a prefix code
+static bool validLengths(const uint8_t lengths[256]) {
+    uint64_t sum = 0;
+    int used = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (lengths[s] > MAX_CODE_LENGTH) return false;
+        if (lengths[s]) {
+            sum += uint64_t(1) << (MAX_CODE_LENGTH - lengths[s]);
+            used++;
+        }
+    }
+    return used > 0 && sum <= (uint64_t(1) << MAX_CODE_LENGTH);
+}
+
+void codeLengths(const uint64_t freq[256], uint8_t lengths[256]) {
+    HuffmanTree tree;
+    buildTree(freq, tree);
+    generateCodeLengths(tree, lengths);
+}
+
+uint64_t containerOverhead(uint64_t size, uint32_t blockSize) {
+    uint64_t blocks = (size + blockSize - 1) / blockSize;
+    return blocks * (BLOCK_HEADER_SIZE + INDEX_ENTRY_SIZE) + HEADER_SIZE + BLOCK_HEADER_SIZE + TRAILER_SIZE;
+}
+
+uint64_t predictCompressedSize(const uint64_t freq[256], uint64_t size, uint32_t blockSize) {
+    uint8_t lengths[256];
+    codeLengths(freq, lengths);
+    uint64_t symbols = 0, bits = 0;
+    int used = 0;
+    for (int s = 0; s < 256; ++s) {
+        symbols += freq[s];
+        bits += freq[s] * lengths[s];
+        used += lengths[s] != 0;
+    }
+    if (symbols == 0 || size == 0) return containerOverhead(0, blockSize);
+
+    // Payload scaled up from the sample, plus a code table and a padding
+    // byte per block
+    uint64_t blocks = (size + blockSize - 1) / blockSize;
+    uint64_t table = std::min(256, used * 2);
+    double payload = static_cast<double>(bits) / symbols * size / 8.0;
+    return static_cast<uint64_t>(payload) + blocks * (table + 1) + containerOverhead(size, blockSize);
+}
+
+size_t huffmanEncode(const unsigned char* data, size_t size, std::vector<unsigned char>& out) {
+    uint64_t freq[256] = {};
+    byteHistogram(data, size, freq);
+
+    uint8_t lengths[256];
+    codeLengths(freq, lengths);
+    HuffCode codes[256];
+    buildCanonicalCodes(lengths, codes);
+
+    // Code length table: dense unless the pair list is shorter
+    size_t tableStart = out.size();
+    int used = 0;
+    for (int s = 0; s < 256; ++s) used += lengths[s] != 0;
+    if (used * 2 < 256) {
+        for (int s = 0; s < 256; ++s) {
+            if (lengths[s]) {
+                out.push_back(static_cast<unsigned char>(s));
+                out.push_back(lengths[s]);
+            }
+        }
+    } else {
+        out.insert(out.end(), lengths, lengths + 256);
+    }
+    size_t tableSize = out.size() - tableStart;
+
+    BitWriter writer(out);
+    for (size_t i = 0; i < size; ++i) {
+        const HuffCode& c = codes[data[i]];
+        writer.put(c.bits, c.length);
+    }
+    writer.finish();
+    return tableSize;
+}
+
+void encodeBlock(const unsigned char* data, size_t size, std::vector<unsigned char>& out, const Codec& codec) {
+    size_t headerPos = out.size();
+    BlockHeader header;
+    header.rawSize = static_cast<uint32_t>(size);
+    header.crc = crc32c(0, data, size);
+    writeBlockHeader(out, header);
+
+    const Codec* used = &codec;
+    size_t tableSize = codec.encode(data, size, out);
+    if (out.size() - headerPos - BLOCK_HEADER_SIZE > size) {
+        // Expanded; raw bytes are never worse
+        used = findCodec("store");
+        out.resize(headerPos + BLOCK_HEADER_SIZE);
+        tableSize = used->encode(data, size, out);
+    }
+
+    // Patch in what is known now
+    header.payloadSize = static_cast<uint32_t>(out.size() - headerPos - BLOCK_HEADER_SIZE - tableSize);
+    header.codec = used->id();
+    header.tableSize = static_cast<uint16_t>(tableSize);
+    packBlockHeader(out.data() + headerPos, header);
+}
+
+void decodeBlock(const unsigned char* table, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                 unsigned char* out, size_t rawSize) {
+    uint8_t lengths[256] = {};
+    if (tableSize == 256) {
+        std::copy(table, table + 256, lengths);
+    } else {
+        if (tableSize % 2 != 0) throw std::runtime_error("Corrupt .huff code table");
+        for (size_t i = 0; i < tableSize; i += 2) lengths[table[i]] = table[i + 1];
+    }
+    if (!validLengths(lengths)) throw std::runtime_error("Corrupt .huff code table");
+
+    TableDecoder decoder(lengths);
+    BitReader reader(payload, payloadSize);
+    const int longest = decoder.longestCode();
+
+    size_t decoded = 0;
+    while (decoded < rawSize) {
+        reader.refill();
+        // Several symbols fit in one refill when codes are short
+        while (reader.available() >= longest && decoded < rawSize) {
+            out[decoded++] = decoder.decode(reader);
+        }
+    }
+}
+
+namespace {
+
+// Writes the container around blocks encoded elsewhere. Offsets are counted
+// rather than asked of the stream, so out may be a pipe. The block index is
+// collected in a buffer the caller keeps between files.
+class ContainerWriter {
+public:
+    ContainerWriter(std::ostream& out, uint32_t blockSize, uint64_t originalSize, uint8_t flags,
+                    std::vector<unsigned char>& index)
+        : out(out), index(index) {
+        index.clear();
+        unsigned char header[HEADER_SIZE] = {};
+        std::copy(FILE_MAGIC, FILE_MAGIC + 4, header);
+        header[4] = FORMAT_VERSION;
+        header[5] = flags;
+        putLE(header + 8, blockSize, 4);
+        putLE(header + 16, originalSize, 8);
+        write(header, HEADER_SIZE);
+    }
+
+    void addBlock(const std::vector<unsigned char>& encoded, uint32_t rawSize) {
+        putLE(index, offset, 8);
+        putLE(index, rawSize, 4);
+        putLE(index, encoded.size(), 4);
+        write(encoded.data(), encoded.size());
+        rawTotal += rawSize;
+        blocks++;
+    }
+
+    // End marker, block index and trailer; returns the container size
+    uint64_t finish() {
+        unsigned char marker[BLOCK_HEADER_SIZE];
+        packBlockHeader(marker, BlockHeader());
+        write(marker, BLOCK_HEADER_SIZE);
+        uint64_t indexOffset = offset;
+        write(index.data(), index.size());
+
+        unsigned char trailer[TRAILER_SIZE];
+        putLE(trailer, indexOffset, 8);
+        putLE(trailer + 8, blocks, 8);
+        putLE(trailer + 16, rawTotal, 8);
+        putLE(trailer + 24, crc32c(0, index.data(), index.size()), 4);
+        std::copy(INDEX_MAGIC, INDEX_MAGIC + 4, trailer + 28);
+        write(trailer, TRAILER_SIZE);
+        out.flush();
+        if (!out) throw std::runtime_error("Failed writing .huff output");
+        return offset;
+    }
+
+private:
+    std::ostream& out;
+    std::vector<unsigned char>& index; // 16 bytes per block, the only part that grows
+    uint64_t offset = 0;
+    uint64_t rawTotal = 0;
+    uint64_t blocks = 0;
+
+    void write(const unsigned char* bytes, size_t size) {
+        out.write(reinterpret_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+        if (!out) throw std::runtime_error("Failed writing .huff output");
+        offset += size;
+    }
+};
+
+struct RawBlock {
+    const unsigned char* data;
+    size_t size;
+};
+
+// Buffers kept by each calling thread from one file to the next, so that
+// compressing or expanding many files in a row stops allocating once they
+// have grown to the working size. Each call keeps what a batch of its block
+// size needs (workingSet), or CONTEXT_KEEP_LIMIT if that is more, and gives
+// back anything beyond, such as what an earlier call with larger blocks left.
+const size_t CONTEXT_KEEP_LIMIT = 64 << 20;
+
+// Bytes a batch of blocks holds: the raw block plus encoded output, whose
+// vector may have grown to twice the block while it was being written
+size_t workingSet(size_t blocks, uint32_t blockSize) {
+    return blocks * 3 * size_t(blockSize);
+}
+
+template <typename T>
+size_t bytesHeld(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+struct EncoderContext {
+    std::vector<std::vector<unsigned char>> encoded; // one per block of a batch
+    std::vector<std::vector<unsigned char>> raw;     // stream input, one per block of a batch
+    std::vector<RawBlock> blocks;
+    std::vector<unsigned char> index;
+
+    void trim(size_t working) {
+        size_t held = bytesHeld(index);
+        for (const auto& v : encoded) held += bytesHeld(v);
+        for (const auto& v : raw) held += bytesHeld(v);
+        if (held > std::max(CONTEXT_KEEP_LIMIT, working)) *this = EncoderContext();
+    }
+};
+
+struct DecoderContext {
+    std::vector<unsigned char> stored;
+    std::vector<unsigned char> raw;
+    std::vector<IndexEntry> index;
+
+    void trim(size_t working) {
+        size_t held = bytesHeld(stored) + bytesHeld(raw) + bytesHeld(index);
+        if (held > std::max(CONTEXT_KEEP_LIMIT, working)) *this = DecoderContext();
+    }
+};
+
+EncoderContext& encoderContext() {
+    thread_local EncoderContext context;
+    return context;
+}
+
+DecoderContext& decoderContext() {
+    thread_local DecoderContext context;
+    return context;
+}
+
+// Decode a block's table and payload (stored right after its header) with
+// the codec the header names
+void decodeStored(const BlockHeader& h, const unsigned char* stored, unsigned char* out) {
+    const Codec* codec = codecById(h.codec);
+    if (!codec) throw std::runtime_error("Unknown codec in .huff block");
+    codec->decode(stored, h.tableSize, stored + h.tableSize, h.payloadSize, out, h.rawSize);
+}
+
+// Codec named by options (already checked), trying each on a sample of data
+// for "auto"
+const Codec& pickCodec(const HuffmanOptions& options, const unsigned char* data, size_t size) {
+    if (options.codec == "auto") return *chooseCodec(data, size).codec;
+    return *findCodec(options.codec);
+}
+
+void encodeOne(const RawBlock& block, const Codec& codec, std::vector<unsigned char>& encoded) {
+    instrument::TraceScope trace("encode-block", block.size);
+    encoded.clear();
+    encodeBlock(block.data, block.size, encoded, codec);
+}
+
+// Encode blocks on the pool, encoded[i] receiving blocks[i]. Without a pool
+// (input of a single block) the calling thread does it.
+void encodeBatch(ThreadPool* pool, const std::vector<RawBlock>& blocks, const Codec& codec,
+                 std::vector<std::vector<unsigned char>>& encoded) {
+    if (!pool) {
+        for (size_t i = 0; i < blocks.size(); ++i) encodeOne(blocks[i], codec, encoded[i]);
+        return;
+    }
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        pool->submit([&, i] {
+            try {
+                encodeOne(blocks[i], codec, encoded[i]);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                failure = std::current_exception();
+            }
+        });
+    }
+    pool->wait();
+    if (failure) std::rethrow_exception(failure);
+}
+
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+void checkOptions(const HuffmanOptions& options) {
+    if (options.blockSize < MIN_BLOCK_SIZE || options.blockSize > MAX_BLOCK_SIZE) {
+        throw std::invalid_argument("Huffman block size out of range");
+    }
+    if (options.codec != "auto" && !findCodec(options.codec)) {
+        throw std::invalid_argument("Unknown codec '" + options.codec + "'");
+    }
+}
+
+HuffmanStats compressFile(const std::string& inputFile, const std::string& outputFile, const HuffmanOptions& options) {
+    checkOptions(options);
+    instrument::PhaseTimer timer(instrument::Phase::Compress);
+    auto startTime = std::chrono::steady_clock::now();
+
+    MappedFile input(inputFile, MappedFile::Sequential);
+    if (!input.isOpen()) throw std::runtime_error("Cannot open " + inputFile);
+    std::ofstream out(outputFile, std::ios::binary);
+    if (!out) throw std::runtime_error("Cannot create " + outputFile);
+
+    const uint32_t blockSize = options.blockSize;
+    const uint64_t totalSize = input.size();
+    const uint64_t blockCount = (totalSize + blockSize - 1) / blockSize;
+    const Codec& codec = pickCodec(options, input.data(), input.size());
+    EncoderContext& context = encoderContext();
+    ContainerWriter writer(out, blockSize, totalSize, 0, context.index);
+
+    // Encode a batch of blocks straight out of the mapping in parallel, then
+    // write them out in order. Two blocks per worker keeps everyone busy.
+    // A file of one block is encoded here, without starting any threads.
+    std::unique_ptr<ThreadPool> pool;
+    if (blockCount > 1) pool = std::make_unique<ThreadPool>(options.threads);
+    const uint64_t batch = pool ? pool->size() * 2 : 1;
+    std::vector<std::vector<unsigned char>>& encoded = context.encoded;
+    if (encoded.size() < batch) encoded.resize(batch);
+    std::vector<RawBlock>& blocks = context.blocks;
+
+    for (uint64_t first = 0; first < blockCount; first += batch) {
+        uint64_t count = std::min(batch, blockCount - first);
+        blocks.clear();
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t start = (first + i) * blockSize;
+            blocks.push_back({input.data() + start, static_cast<size_t>(std::min<uint64_t>(blockSize, totalSize - start))});
+        }
+        encodeBatch(pool.get(), blocks, codec, encoded);
+        for (uint64_t i = 0; i < count; ++i) writer.addBlock(encoded[i], static_cast<uint32_t>(blocks[i].size));
+    }
+
+    HuffmanStats stats;
+    stats.inputBytes = totalSize;
+    stats.outputBytes = writer.finish();
+    out.close();
+    context.trim(workingSet(batch, blockSize));
+    instrument::addBytes(instrument::Phase::Compress, totalSize);
+    instrument::addFiles(instrument::Phase::Compress, 1);
+    stats.seconds = secondsSince(startTime);
+    stats.threads = pool ? pool->size() : 1;
+    stats.codec = codec.name();
+    return stats;
+}
+
+HuffmanStats compressStream(std::istream& in, std::ostream& out, const HuffmanOptions& options) {
+    checkOptions(options);
+    instrument::PhaseTimer timer(instrument::Phase::Compress);
+    auto startTime = std::chrono::steady_clock::now();
+
+    const uint32_t blockSize = options.blockSize;
+    EncoderContext& context = encoderContext();
+    ContainerWriter writer(out, blockSize, 0, FLAG_STREAMED, context.index);
+
+    // Same batching as compressFile, but each batch is read into a fixed set
+    // of buffers that are reused for the whole stream
+    ThreadPool pool(options.threads);
+    const size_t batch = pool.size() * 2;
+    std::vector<std::vector<unsigned char>>& raw = context.raw;
+    std::vector<std::vector<unsigned char>>& encoded = context.encoded;
+    if (raw.size() < batch) raw.resize(batch);
+    if (encoded.size() < batch) encoded.resize(batch);
+    for (size_t i = 0; i < batch; ++i) raw[i].resize(blockSize);
+    std::vector<RawBlock>& blocks = context.blocks;
+    uint64_t totalSize = 0;
+    const Codec* codec = options.codec == "auto" ? nullptr : &pickCodec(options, nullptr, 0);
+
+    bool atEnd = false;
+    while (!atEnd) {
+        blocks.clear();
+        while (blocks.size() < batch && !atEnd) {
+            std::vector<unsigned char>& buffer = raw[blocks.size()];
+            in.read(reinterpret_cast<char*>(buffer.data()), blockSize);
+            size_t got = static_cast<size_t>(in.gcount());
+            atEnd = got < blockSize;
+            if (got > 0) blocks.push_back({buffer.data(), got});
+        }
+        if (in.bad()) throw std::runtime_error("Failed reading compression input");
+
+        // With "auto" the first block stands in for the whole stream
+        if (!codec) codec = &pickCodec(options, blocks.empty() ? nullptr : blocks[0].data,
+                                       blocks.empty() ? 0 : blocks[0].size);
+        encodeBatch(&pool, blocks, *codec, encoded);
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            writer.addBlock(encoded[i], static_cast<uint32_t>(blocks[i].size));
+            totalSize += blocks[i].size;
+        }
+    }
+
+    HuffmanStats stats;
+    stats.inputBytes = totalSize;
+    stats.outputBytes = writer.finish();
+    context.trim(workingSet(batch, blockSize));
+    instrument::addBytes(instrument::Phase::Compress, totalSize);
+    instrument::addFiles(instrument::Phase::Compress, 1);
+    stats.seconds = secondsSince(startTime);
+    stats.threads = pool.size();
+    stats.codec = codec->name();
+    return stats;
+}
+
+HuffmanStats decompressStream(std::istream& in, std::ostream& out) {
+    instrument::PhaseTimer timer(instrument::Phase::Decompress);
+    auto startTime = std::chrono::steady_clock::now();
+
+    unsigned char header[HEADER_SIZE];
+    readExact(in, header, HEADER_SIZE);
+    if (!std::equal(FILE_MAGIC, FILE_MAGIC + 4, header)) throw std::runtime_error("Not a .huff file");
+    if (header[4] != FORMAT_VERSION) throw std::runtime_error("Unsupported .huff version");
+    bool streamed = header[5] & FLAG_STREAMED;
+    uint32_t blockSize = static_cast<uint32_t>(getLE(header + 8, 4));
+    uint64_t originalSize = getLE(header + 16, 8);
+    if (blockSize == 0 || blockSize > MAX_BLOCK_SIZE) throw std::runtime_error("Corrupt .huff header");
+
+    DecoderContext& context = decoderContext();
+    std::vector<unsigned char>& stored = context.stored;
+    std::vector<unsigned char>& raw = context.raw;
+    raw.resize(blockSize);
+    uint64_t totalSize = 0, blockCount = 0, inputBytes = HEADER_SIZE;
+    while (true) {
+        unsigned char bh[BLOCK_HEADER_SIZE];
+        readExact(in, bh, BLOCK_HEADER_SIZE);
+        inputBytes += BLOCK_HEADER_SIZE;
+        BlockHeader h = readBlockHeader(bh);
+        if (h.rawSize == 0 && h.payloadSize == 0) break;
+        if (!plausibleBlock(h, blockSize)) throw std::runtime_error("Corrupt .huff block");
+
+        stored.resize(h.tableSize + h.payloadSize);
+        readExact(in, stored.data(), stored.size());
+        inputBytes += stored.size();
+        instrument::TraceScope trace("decode-block", h.rawSize);
+        decodeStored(h, stored.data(), raw.data());
+        if (crc32c(0, raw.data(), h.rawSize) != h.crc) throw std::runtime_error("CRC mismatch in .huff block");
+
+        out.write(reinterpret_cast<const char*>(raw.data()), h.rawSize);
+        if (!out) throw std::runtime_error("Failed writing decompressed output");
+        totalSize += h.rawSize;
+        blockCount++;
+    }
+
+    // The index follows; check it against what was decoded without holding
+    // it in memory. A streamed file only records its size here.
+    uint32_t indexCrc = 0;
+    for (uint64_t left = blockCount * INDEX_ENTRY_SIZE; left > 0;) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(left, 4096 * INDEX_ENTRY_SIZE));
+        stored.resize(chunk);
+        readExact(in, stored.data(), chunk);
+        indexCrc = crc32c(indexCrc, stored.data(), chunk);
+        left -= chunk;
+    }
+    unsigned char trailer[TRAILER_SIZE];
+    readExact(in, trailer, TRAILER_SIZE);
+    inputBytes += blockCount * INDEX_ENTRY_SIZE + TRAILER_SIZE;
+    if (!std::equal(INDEX_MAGIC, INDEX_MAGIC + 4, trailer + 28) || getLE(trailer + 8, 8) != blockCount ||
+        static_cast<uint32_t>(getLE(trailer + 24, 4)) != indexCrc) {
+        throw std::runtime_error("Corrupt .huff block index");
+    }
+    if (streamed) originalSize = getLE(trailer + 16, 8);
+    if (totalSize != originalSize || getLE(trailer + 16, 8) != originalSize) {
+        throw std::runtime_error("Size mismatch in .huff file");
+    }
+    out.flush();
+    if (!out) throw std::runtime_error("Failed writing decompressed output");
+    context.trim(workingSet(1, blockSize));
+
+    instrument::addBytes(instrument::Phase::Decompress, inputBytes);
+    instrument::addFiles(instrument::Phase::Decompress, 1);
+
+    HuffmanStats stats;
+    stats.inputBytes = inputBytes;
+    stats.outputBytes = totalSize;
+    stats.seconds = secondsSince(startTime);
+    return stats;
+}
+
+HuffmanStats decompressFile(const std::string& inputFile, const std::string& outputFile) {
+    std::ifstream in(inputFile, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + inputFile);
+    std::ofstream out(outputFile, std::ios::binary);
+    if (!out) throw std::runtime_error("Cannot create " + outputFile);
+
+    HuffmanStats stats = decompressStream(in, out);
+    out.close();
+    if (!out) throw std::runtime_error("Failed writing " + outputFile);
+    return stats;
+}
+
+uint64_t decompressRange(const std::string& inputFile, uint64_t offset, uint64_t length, std::ostream& out) {
+    instrument::PhaseTimer timer(instrument::Phase::Decompress);
+    std::ifstream in(inputFile, std::ios::binary);
+    if (!in) throw std::runtime_error("Cannot open " + inputFile);
+
+    DecoderContext& context = decoderContext();
+    std::vector<unsigned char>& stored = context.stored;
+    std::vector<unsigned char>& raw = context.raw;
+    std::vector<IndexEntry>& index = context.index;
+    uint64_t originalSize = 0;
+    readIndex(in, originalSize, index, stored);
+    if (offset >= originalSize || length == 0) return 0;
+    uint64_t end = offset + std::min(length, originalSize - offset);
+
+    // First block whose range ends after offset
+    auto it = std::upper_bound(index.begin(), index.end(), offset,
+                               [](uint64_t value, const IndexEntry& e) { return value < e.rawOffset + e.rawSize; });
+
+    uint64_t written = 0;
+    uint32_t largest = 0;
+    for (; it != index.end() && it->rawOffset < end; ++it) {
+        if (it->storedSize > BLOCK_HEADER_SIZE + uint64_t(it->rawSize) + MAX_TABLE_SIZE) {
+            throw std::runtime_error("Corrupt .huff block");
+        }
+        stored.resize(it->storedSize);
+        in.seekg(static_cast<std::streamoff>(it->fileOffset));
+        readExact(in, stored.data(), stored.size());
+        instrument::addBytes(instrument::Phase::Decompress, stored.size());
+
+        BlockHeader h = readBlockHeader(stored.data());
+        if (h.rawSize != it->rawSize || !plausibleBlock(h, MAX_BLOCK_SIZE) ||
+            BLOCK_HEADER_SIZE + h.tableSize + uint64_t(h.payloadSize) != it->storedSize) {
+            throw std::runtime_error("Corrupt .huff block");
+        }
+
+        raw.resize(h.rawSize);
+        largest = std::max(largest, h.rawSize);
+        decodeStored(h, stored.data() + BLOCK_HEADER_SIZE, raw.data());
+        if (crc32c(0, raw.data(), h.rawSize) != h.crc) throw std::runtime_error("CRC mismatch in " + inputFile);
+
+        uint64_t from = std::max(offset, it->rawOffset) - it->rawOffset;
+        uint64_t to = std::min(end, it->rawOffset + h.rawSize) - it->rawOffset;
+        out.write(reinterpret_cast<const char*>(raw.data() + from), static_cast<std::streamsize>(to - from));
+        written += to - from;
+    }
+    if (!out) throw std::runtime_error("Failed writing decompressed range");
+    context.trim(workingSet(1, largest));
+    return written;
+}
@@ -1,20 +1,112 @@
-#ifndef HUFFMAN_H
-#define HUFFMAN_H
-
-#include <string>
-#include <unordered_map>
-#include <fstream>
-
-// Forward declaration for internal Node structure
-struct Node;
-
-// Main compression/decompression functions (these match your huffman.cpp)
-void compressFile(const std::string& inputFile, const std::string& outputFile);
-void decompressFile(const std::string& inputFile, const std::string& outputFile);
-
-// Internal helper functions (optional to declare, but good practice)
-Node* buildTree(std::unordered_map<char, int>& freq);
-void generateCodes(Node* root, const std::string& code, std::unordered_map<char, std::string>& codes);
-void writeCompressedData(std::ifstream& in, const std::unordered_map<char, std::string>& codes, std::ofstream& out);
-
-#endif
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+class Codec;
+
+// Longest code the bit writer/reader can handle in one step
+const int MAX_CODE_LENGTH = 56;
+
+// One entry of the flat code table, indexed by byte value
+struct HuffCode {
+    uint64_t bits = 0; // right-aligned code
+    int length = 0;    // 0 if the byte never occurs
+};
+
+struct HuffmanOptions {
+    uint32_t blockSize = 1 << 20; // bytes per independently coded block
+    unsigned threads = 0;         // encoder threads, 0 = one per core
+    std::string codec = "huffman"; // a codecNames() entry, or "auto" to pick by trial on a sample
+};
+
+// What one compress/decompress call did; callers decide how to report it
+struct HuffmanStats {
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    double seconds = 0.0;
+    unsigned threads = 1;
+    std::string codec; // codec used for compression
+};
+
+// Throws std::invalid_argument for an out-of-range block size or unknown
+// codec, as the compress functions do before touching any file
+void checkOptions(const HuffmanOptions& options);
+
+// Main compression/decompression functions. The output is a versioned .huff
+// container (magic, original size, independently coded blocks, each naming
+// its codec and carrying a CRC32C, block index). options.codec picks the
+// codec (see codec.h). Errors are thrown as std::runtime_error.
+HuffmanStats compressFile(const std::string& inputFile, const std::string& outputFile,
+                          const HuffmanOptions& options = HuffmanOptions());
+HuffmanStats decompressFile(const std::string& inputFile, const std::string& outputFile);
+
+// The same container, produced and consumed front to back so either side can
+// be a pipe. Memory stays bounded whatever the stream length: compression
+// reads a batch of two blocks per thread and keeps up to three block sizes
+// per batch block (the raw block, and its encoded output, which may grow to
+// twice a block while it is written) plus 16 bytes of index per block;
+// decompression holds one block. A compressed stream records its size in
+// the trailer only; decompressFile and decompressRange read it either way.
+HuffmanStats compressStream(std::istream& in, std::ostream& out, const HuffmanOptions& options = HuffmanOptions());
+HuffmanStats decompressStream(std::istream& in, std::ostream& out);
+
+// Decode only the blocks covering [offset, offset + length) of the original
+// file, located through the block index, and write those bytes to out.
+// Returns the number of bytes written (less than length at end of file).
+uint64_t decompressRange(const std::string& inputFile, uint64_t offset, uint64_t length, std::ostream& out);
+
+// Huffman tree in a fixed pool of nodes linked by index: the leaves sorted
+// by frequency first, then the internal nodes in the order they were
+// merged, the root last. 256 symbols need at most 511 nodes, so building a
+// tree never allocates.
+struct HuffmanTree {
+    static const int MAX_NODES = 2 * 256 - 1;
+
+    struct Node {
+        uint64_t freq;
+        int16_t left;   // -1 for a leaf
+        int16_t right;
+        uint8_t symbol; // leaves only
+    };
+
+    Node nodes[MAX_NODES];
+    int leaves = 0;
+    int count = 0; // nodes in use, 0 for an empty histogram
+};
+
+// From a histogram to codes. buildTree merges the two lightest nodes until
+// one is left (ties broken by symbol, so a histogram always gives the same
+// tree); generateCodeLengths reads off each leaf's depth; buildCanonicalCodes
+// numbers the codes in order of length, then symbol, so a block only needs
+// to carry the lengths and the decoder rebuilds the same codes from them.
+void buildTree(const uint64_t freq[256], HuffmanTree& tree);
+void generateCodeLengths(const HuffmanTree& tree, uint8_t lengths[256]); // 0 for absent symbols
+void buildCanonicalCodes(const uint8_t lengths[256], HuffCode codes[256]);
+
+// Code lengths for a byte histogram (buildTree + generateCodeLengths)
+void codeLengths(const uint64_t freq[256], uint8_t lengths[256]);
+
+// Container bytes around the coded blocks of a size-byte input
+uint64_t containerOverhead(uint64_t size, uint32_t blockSize = HuffmanOptions().blockSize);
+
+// Size of the .huff container for size bytes whose byte distribution is freq
+// (a whole-file histogram or a sample of it)
+uint64_t predictCompressedSize(const uint64_t freq[256], uint64_t size, uint32_t blockSize = HuffmanOptions().blockSize);
+
+// Append one coded block (header, codec table, payload) to out. A block the
+// codec would expand is stored raw instead.
+void encodeBlock(const unsigned char* data, size_t size, std::vector<unsigned char>& out, const Codec& codec);
+
+// The Huffman codec itself: append code length table and payload to out and
+// return the table size; decode the pair back into rawSize bytes
+size_t huffmanEncode(const unsigned char* data, size_t size, std::vector<unsigned char>& out);
+void decodeBlock(const unsigned char* table, size_t tableSize, const unsigned char* payload, size_t payloadSize,
+                 unsigned char* out, size_t rawSize);
+
+#endif
@@ -0,0 +1,203 @@
+#include "instrument.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+namespace instrument {
+
+namespace {
+
+struct PhaseState {
+    std::mutex mutex;   // guards active and the start/total times
+    int active = 0;
+    int64_t startUs = 0;
+    double startCpu = 0.0;
+    uint64_t calls = 0;
+    int64_t wallUs = 0;
+    double cpuSeconds = 0.0;
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> files{0};
+};
+
+PhaseState phases[PHASE_COUNT];
+
+const char* const NAMES[PHASE_COUNT] = {"scan", "hash", "estimate", "rank", "compress", "decompress"};
+
+struct Event {
+    const char* name;
+    int tid;
+    int64_t startUs;
+    int64_t durationUs;
+    uint64_t bytes;
+};
+
+// Enough for a few hours of per-block events; later ones are dropped rather
+// than letting a forgotten trace grow without bound
+const size_t MAX_EVENTS = 1 << 20;
+
+std::atomic<bool> traceOn{false};
+std::mutex traceMutex;
+std::vector<Event> events;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+// CPU time of the whole process, all threads
+double cpuNow() {
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0) return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+// Small stable ids read better in the trace viewer than native thread ids
+int threadId() {
+    static std::atomic<int> next{1};
+    thread_local int id = next++;
+    return id;
+}
+
+void record(const char* name, int64_t startUs, int64_t endUs, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!traceOn.load(std::memory_order_relaxed) || events.size() >= MAX_EVENTS) return;
+    events.push_back({name, threadId(), startUs, endUs - startUs, bytes});
+}
+
+PhaseState& state(Phase phase) {
+    return phases[static_cast<int>(phase)];
+}
+
+} // namespace
+
+const char* phaseName(Phase phase) {
+    return NAMES[static_cast<int>(phase)];
+}
+
+std::vector<PhaseStats> snapshot() {
+    std::vector<PhaseStats> result(PHASE_COUNT);
+    int64_t now = nowUs();
+    double cpu = cpuNow();
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        PhaseState& s = phases[i];
+        PhaseStats& out = result[i];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        out.name = NAMES[i];
+        out.calls = s.calls;
+        out.wallSeconds = s.wallUs * 1e-6;
+        out.cpuSeconds = s.cpuSeconds;
+        if (s.active > 0) { // include the part of a running section so far
+            out.wallSeconds += (now - s.startUs) * 1e-6;
+            out.cpuSeconds += cpu - s.startCpu;
+        }
+        out.bytes = s.bytes.load(std::memory_order_relaxed);
+        out.files = s.files.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+std::vector<PhaseStats> since(const std::vector<PhaseStats>& earlier) {
+    std::vector<PhaseStats> result = snapshot();
+    for (size_t i = 0; i < result.size() && i < earlier.size(); ++i) {
+        result[i].calls -= earlier[i].calls;
+        result[i].wallSeconds -= earlier[i].wallSeconds;
+        result[i].cpuSeconds -= earlier[i].cpuSeconds;
+        result[i].bytes -= earlier[i].bytes;
+        result[i].files -= earlier[i].files;
+    }
+    return result;
+}
+
+void reset() {
+    int64_t now = nowUs();
+    double cpu = cpuNow();
+    for (PhaseState& s : phases) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.calls = 0;
+        s.wallUs = 0;
+        s.cpuSeconds = 0.0;
+        s.startUs = now; // running sections count from here
+        s.startCpu = cpu;
+        s.bytes = 0;
+        s.files = 0;
+    }
+}
+
+void addBytes(Phase phase, uint64_t bytes) {
+    state(phase).bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void addFiles(Phase phase, uint64_t files) {
+    state(phase).files.fetch_add(files, std::memory_order_relaxed);
+}
+
+PhaseTimer::PhaseTimer(Phase phase) : phase(phase), startUs(nowUs()) {
+    PhaseState& s = state(phase);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.calls++;
+    if (s.active++ == 0) {
+        s.startUs = startUs;
+        s.startCpu = cpuNow();
+    }
+}
+
+PhaseTimer::~PhaseTimer() {
+    int64_t endUs = nowUs();
+    PhaseState& s = state(phase);
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (--s.active == 0) {
+            s.wallUs += endUs - s.startUs;
+            s.cpuSeconds += cpuNow() - s.startCpu;
+        }
+    }
+    if (traceOn.load(std::memory_order_relaxed)) record(phaseName(phase), startUs, endUs, 0);
+}
+
+TraceScope::TraceScope(const char* name, uint64_t bytes)
+    : name(name), bytes(bytes), startUs(traceOn.load(std::memory_order_relaxed) ? nowUs() : -1) {}
+
+TraceScope::~TraceScope() {
+    if (startUs >= 0) record(name, startUs, nowUs(), bytes);
+}
+
+void startTrace() {
+    std::lock_guard<std::mutex> lock(traceMutex);
+    events.clear();
+    traceOn = true;
+}
+
+bool tracing() {
+    return traceOn.load(std::memory_order_relaxed);
+}
+
+void writeTrace(const std::string& path) {
+    std::vector<Event> collected;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        traceOn = false;
+        collected.swap(events);
+    }
+
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) throw std::runtime_error("Cannot write trace file " + path);
+    // Event names are identifiers from the code, so they need no escaping
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < collected.size(); ++i) {
+        const Event& e = collected[i];
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << e.name << "\",\"cat\":\"storage\",\"ph\":\"X\",\"pid\":1"
+            << ",\"tid\":" << e.tid << ",\"ts\":" << e.startUs << ",\"dur\":" << e.durationUs;
+        if (e.bytes) out << ",\"args\":{\"bytes\":" << e.bytes << "}";
+        out << "}";
+    }
+    out << "\n]}\n";
+    if (!out) throw std::runtime_error("Failed writing trace file " + path);
+}
+
+} // namespace instrument
@@ -0,0 +1,85 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Process-wide counters and timers for the expensive phases of a run.
+// Counting is always on and costs a few atomic adds per phase; trace events
+// are only collected between startTrace() and writeTrace().
+namespace instrument {
+
+enum class Phase { Scan, Hash, Estimate, Rank, Compress, Decompress };
+
+const int PHASE_COUNT = 6;
+
+const char* phaseName(Phase phase);
+
+struct PhaseStats {
+    std::string name;
+    uint64_t calls = 0;        // timed sections started
+    double wallSeconds = 0.0;  // time at least one section of the phase was running
+    double cpuSeconds = 0.0;   // process CPU time (all threads) over that wall time
+    uint64_t bytes = 0;        // bytes read (scan: none, hash/estimate: from disk)
+    uint64_t files = 0;
+
+    double mbPerSecond() const { return wallSeconds > 0 ? bytes / (1024.0 * 1024.0) / wallSeconds : 0.0; }
+};
+
+// One entry per phase, in Phase order, including the idle ones
+std::vector<PhaseStats> snapshot();
+
+// later - earlier, for reporting one step of a longer run
+std::vector<PhaseStats> since(const std::vector<PhaseStats>& earlier);
+
+void reset();
+
+void addBytes(Phase phase, uint64_t bytes);
+void addFiles(Phase phase, uint64_t files);
+
+// Times one call into a phase. Overlapping timers of the same phase, from
+// any thread, count their wall and CPU time once. Another phase running at
+// the same time in another thread shares the process CPU time, so phase
+// CPU times only add up when phases run one after another.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(Phase phase);
+    ~PhaseTimer();
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    Phase phase;
+    int64_t startUs;
+};
+
+// A span that only shows up in the trace, for work finer than a phase
+// (one block, one file). name must outlive the trace (a string literal).
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, uint64_t bytes = 0);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t bytes;
+    int64_t startUs; // -1 when tracing was off at construction
+};
+
+// Collect Chrome trace events (chrome://tracing, Perfetto) from now on,
+// dropping any collected before
+void startTrace();
+bool tracing();
+
+// Write the events collected so far as trace-event JSON and stop tracing.
+// Throws std::runtime_error if path cannot be written.
+void writeTrace(const std::string& path);
+
+} // namespace instrument
+
+#endif
@@ -0,0 +1,199 @@
+#include "interactive.h"
+#include "utils.h"
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <cctype>
+#include <cstdint>
+
+namespace fs = std::filesystem;
+
+void handleDuplicates(FileTable& files, const DuplicateOptions& options) {
+    DuplicateStats stats;
+    auto groups = findDuplicates(files, &stats, options);
+
+    std::cout << "Duplicate scan: " << stats.filesConsidered << " files, "
+              << stats.sizeCandidates << " same-size candidates, "
+              << stats.partialHashed << " partial hashes, "
+              << stats.fullHashed << " full hashes, "
+              << stats.strongHashed << " strong confirmations, "
+              << stats.hashesReused << " cached hashes reused" << std::endl;
+    std::cout << "Read " << formatSizeMB(stats.bytesRead) << " of "
+              << formatSizeMB(stats.bytesTotal) << " ("
+              << formatSizeMB(stats.bytesTotal - std::min(stats.bytesRead, stats.bytesTotal))
+              << " avoided)" << std::endl;
+    
+    std::vector<FileTable::Id> removed;
+    int groupNum = 1;
+    for (const auto& pair : groups) {
+        if (pair.second.size() > 1) {
+            std::cout << "=== Duplicate group " << groupNum << " ===" << std::endl;
+            for (FileTable::Id id : pair.second) {
+                std::cout << "- " << files.name(id) << " (" << files.path(id) << ")" << std::endl;
+            }
+            
+            std::cout << "Delete, hard-link or reflink duplicates? (d/h/r/n): ";
+            char choice;
+            std::cin >> choice;
+            choice = static_cast<char>(std::tolower(static_cast<unsigned char>(choice)));
+
+            // Links keep every path valid for other users of the tree
+            DedupeAction action = DedupeAction::Delete;
+            if (choice == 'h') action = DedupeAction::HardLink;
+            else if (choice == 'r') action = DedupeAction::Reflink;
+
+            if (choice == 'd' || choice == 'y' || choice == 'h' || choice == 'r') {
+                std::string keep = files.path(pair.second[0]);
+                uint64_t keepInode = files.inode(pair.second[0]);
+                for (size_t i = 1; i < pair.second.size(); ++i) {
+                    std::string dup = files.path(pair.second[i]);
+                    std::error_code ec;
+                    if (keepInode != 0 && files.inode(pair.second[i]) == keepInode && fs::equivalent(keep, dup, ec)) {
+                        std::cout << "Already linked: " << dup << std::endl;
+                        continue;
+                    }
+                    std::string error;
+                    if (!dedupeFile(keep, dup, action, error)) {
+                        std::cerr << "Error: " << error << std::endl;
+                    } else if (action == DedupeAction::Delete) {
+                        removed.push_back(pair.second[i]);
+                        std::cout << "Deleted: " << dup << std::endl;
+                    } else {
+                        std::cout << (action == DedupeAction::HardLink ? "Linked: " : "Reflinked: ")
+                                  << dup << std::endl;
+                    }
+                }
+            }
+            groupNum++;
+        }
+    }
+    files.erase(std::move(removed));
+}
+
+// True if the file is gone from disk
+static bool deleteFile(const std::string& path) {
+    try {
+        fs::remove(path);
+        std::cout << "Deleted: " << path << std::endl;
+        return true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error deleting " << path << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+static void compressFiles(optimizer& opt, FileTable& files, const std::vector<FileTable::Id>& ids) {
+    std::cout << "Compressing " << ids.size() << " file(s), " << BatchCompressOptions().jobs
+              << " at a time..." << std::endl;
+    std::vector<BatchCompressResult> results = opt.compressFiles(files, ids);
+
+    uint64_t before = 0, after = 0;
+    size_t done = 0;
+    for (const BatchCompressResult& r : results) {
+        if (!r.error.empty()) {
+            std::cerr << "Skipped " << files.path(r.id) << ": " << r.error << std::endl;
+        }
+        if (r.output.empty()) continue;
+        std::cout << "Compressed " << r.output << " with " << r.stats.codec << ": "
+                  << r.stats.inputBytes / (1024.0 * 1024.0) << " MB -> "
+                  << r.stats.outputBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+        before += r.stats.inputBytes;
+        after += r.stats.outputBytes;
+        done++;
+    }
+    std::cout << done << " of " << ids.size() << " file(s) compressed, "
+              << (before - std::min(before, after)) / (1024.0 * 1024.0) << " MB saved" << std::endl;
+}
+
+void optimizeFiles(optimizer& opt, FileTable& files) {
+    std::cout << "\nRanking " << files.size() << " files" << std::endl;
+    std::cout << "Total Space: " << opt.capacity() << " MB" << std::endl;
+
+    RankingReport report;
+    std::vector<FileTable::Id> ranked = opt.rankFilesKnapsack(files, &report);
+
+    std::cout << "Method: " << report.method << " using " << report.memoryBytes / (1024.0 * 1024.0)
+              << " MB of " << report.memoryBudget / (1024.0 * 1024.0) << " MB budget" << std::endl;
+    if (report.upperBound > report.value) {
+        std::cout << "Selected value " << report.value << " is at most "
+                  << 100.0 * (report.upperBound - report.value) / report.upperBound
+                  << "% below the optimum" << std::endl;
+    }
+    std::cout << "Knapsack selected " << ranked.size() << " files for optimization" << std::endl;
+    
+    if (ranked.empty()) {
+        std::cout << "No files available for optimization." << std::endl;
+        return;
+    }
+    
+    std::cout << "\n=== Optimized file ranking (Knapsack) ===" << std::endl;
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        std::cout << i + 1 << ". " << files.name(ranked[i]) 
+                  << " (" << files.sizeOf(ranked[i]) / (1024.0 * 1024.0) << " MB)" << std::endl;
+    }
+    
+    std::vector<FileTable::Id> compressible;
+    for (FileTable::Id id : ranked) {
+        if (opt.shouldCompress(files, id, &report)) compressible.push_back(id);
+    }
+    if (!compressible.empty()) {
+        std::cout << "\n" << compressible.size() << " of the selected files look compressible. "
+                  << "Compress them all now? (y/n): ";
+        char answer;
+        std::cin >> answer;
+        if (answer == 'y' || answer == 'Y') {
+            compressFiles(opt, files, compressible);
+            return;
+        }
+    }
+
+    int choice;
+    while (true) {
+        std::cout << "\nEnter the rank of the file you want to proceed with (1-" 
+                  << ranked.size() << ", 0 to exit): ";
+        std::cin >> choice;
+        
+        if (choice == 0) {
+            std::cout << "Exiting..." << std::endl;
+            return;
+        }
+        
+        if (choice < 1 || choice > static_cast<int>(ranked.size())) {
+            std::cout << "Invalid choice. Please enter a number between 1 and " 
+                      << ranked.size() << std::endl;
+            continue;
+        }
+        
+        break;
+    }
+    
+    FileTable::Id selected = ranked[choice - 1];
+    std::string path = files.path(selected);
+    
+    if (opt.shouldCompress(files, selected, &report)) {
+        std::cout << "File " << files.name(selected) << " looks compressible." << std::endl;
+        std::cout << "Options:\n1. Delete\n2. Compress" << std::endl;
+        int action;
+        std::cin >> action;
+        
+        if (action == 1) {
+            if (deleteFile(path)) files.erase({selected});
+        } else if (action == 2) {
+            compressFiles(opt, files, {selected});
+        } else {
+            std::cout << "Invalid option." << std::endl;
+        }
+    } else {
+        std::cout << "File " << files.name(selected) << " is not worth compressing." << std::endl;
+        std::cout << "Options:\n1. Delete" << std::endl;
+        int action;
+        std::cin >> action;
+        
+        if (action == 1) {
+            if (deleteFile(path)) files.erase({selected});
+        } else {
+            std::cout << "Invalid option." << std::endl;
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef INTERACTIVE_H
+#define INTERACTIVE_H
+
+#include "duplicates.h"
+#include "optimizer.h"
+
+// Menu-driven steps of the interactive tool. These talk to the user on
+// std::cin/std::cout; the core calls they wrap stay free of console I/O.
+
+// Find duplicates and ask per group whether to delete, hard-link or reflink
+// the copies; deleted rows are removed from files
+void handleDuplicates(FileTable& files, const DuplicateOptions& options = DuplicateOptions());
+
+// Rank files with opt, then offer to compress the compressible ones or to
+// delete / compress one picked by rank
+void optimizeFiles(optimizer& opt, FileTable& files);
+
+#endif
@@ -4,13 +4,19 @@
 #include "utils.h"
 #include "summary.h"
 #include "huffman.h"
-#include "utils.h"
+#include "entropy.h"
+#include "scanindex.h"
+#include "watcher.h"
+#include "cli.h"
+#include "interactive.h"
+#include "instrument.h"
 #include <iostream>
 #include <string>
 #include <vector>
 #include <iomanip>
 #include <map>
 #include <filesystem>
+#include <csignal>
 
 void displayHeader()
 {
@@ -26,7 +32,7 @@ void displayMenu()
     std::cout << "1. Scan Directory\n";
     std::cout << "2. Find & Handle Duplicates\n";
     std::cout << "3. Optimize Files (Ranking System)\n";
-    std::cout << "4. Compress a File (Huffman)\n";
+    std::cout << "4. Compress a File (Huffman/LZ77/RLE)\n";
     std::cout << "5. View Summary Report\n";
     std::cout << "6. Exit Program\n";
     std::cout << "-----------------------------------\n";
@@ -44,16 +50,29 @@ void displayScanResults(const ScanResult &result)
               << result.freeSpace << " MB\n";
 }
 
-void displayFileList(const std::vector<FileInfo> &files)
+void displayFileList(const FileTable &files)
 {
     std::cout << "\nAvailable Files:\n";
-    for (size_t i = 0; i < files.size(); ++i)
+    for (auto file : files)
     {
-        std::cout << (i + 1) << ". " << files[i].name
-                  << " (" << formatSizeMB(files[i].size) << " MB)\n";
+        std::cout << (file.id() + 1) << ". " << file.name()
+                  << " (" << formatSizeMB(file.size()) << " MB)\n";
     }
 }
 
+// Totals of the working set after files were removed or shrunk
+ScanTotals recount(const ScanResult &scan)
+{
+    ScanTotals totals = scan.totals();
+    totals.usedSpace = 0;
+    for (uint64_t size : scan.files.sizes())
+    {
+        totals.usedSpace += size / (1024.0 * 1024.0);
+    }
+    totals.freeSpace = totals.totalSpace - totals.usedSpace;
+    return totals;
+}
+
 void waitForInput()
 {
     std::cout << "\nPress Enter to continue...";
@@ -61,13 +80,65 @@ void waitForInput()
     std::cin.get();
 }
 
-int main()
+static volatile std::sig_atomic_t stopWatching = 0;
+
+static void onInterrupt(int)
+{
+    stopWatching = 1;
+}
+
+// Long-running mode: keep the file table and duplicate groups current from
+// filesystem events and report after every batch of changes
+int runWatchMode(const std::string &directory)
+{
+    LiveIndex live(directory);
+    std::cout << "Watching " << directory << " (Ctrl+C to stop)...\n";
+    if (!live.start())
+    {
+        std::cout << "ERROR: Filesystem notifications are not available on this system.\n";
+        return 1;
+    }
+
+    std::signal(SIGINT, onInterrupt);
+    std::signal(SIGTERM, onInterrupt);
+
+    size_t changes = live.fileCount();
+    while (!stopWatching)
+    {
+        if (changes > 0)
+        {
+            std::cout << "[watch] " << live.fileCount() << " files in " << live.directoryCount()
+                      << " directories, " << live.duplicateGroups().size() << " duplicate groups, "
+                      << formatSizeMB(live.reclaimableBytes()) << " reclaimable\n";
+        }
+        changes = live.poll(1000);
+    }
+
+    std::cout << "\nStopped watching.\n";
+    return 0;
+}
+
+int main(int argc, char *argv[])
 {
+    if (argc == 3 && std::string(argv[1]) == "--watch")
+    {
+        return runWatchMode(argv[2]);
+    }
+    if (argc > 1)
+    {
+        // Scripted use: never fall through to the interactive menu
+        return runBatch(argc, argv);
+    }
+
     displayHeader();
 
-    // State variables
-    ScanResult initialScan, currentState;
-    std::vector<FileInfo> files;
+    // State variables. The scan owns the one file table every step works
+    // on; before/after reports only keep totals.
+    ScanResult scan;
+    FileTable &files = scan.files;
+    ScanTotals initialTotals, currentTotals;
+    std::string indexPath;
+    const DuplicateOptions hashOptions;
     optimizer *opt = nullptr;
 
     bool isScanned = false;
@@ -95,10 +166,21 @@ int main()
 
             std::cout << "Scanning directory...\n";
 
-            initialScan = scanDirectory(directory);
-            currentState = initialScan;
-            files = initialScan.files;
+            // Reuse what is still valid from the last scan of this directory
+            indexPath = defaultIndexPath(directory);
+            ScanIndex previous;
+            if (!indexPath.empty()) previous.load(indexPath, hashOptions.fastHash, hashOptions.strongHash);
 
+            instrument::reset(); // the final summary covers this scan onwards
+            scan = scanDirectory(directory, 0, &previous);
+            initialTotals = currentTotals = scan.totals();
+
+            if (!scan.error.empty())
+            {
+                std::cout << "ERROR: " << scan.error << "\n";
+                waitForInput();
+                break;
+            }
             if (files.empty())
             {
                 std::cout << "ERROR: No files found or directory inaccessible!\n";
@@ -108,15 +190,25 @@ int main()
 
             if (opt != nullptr)
                 delete opt;
-            opt = new optimizer(initialScan.totalSpace);
+            opt = new optimizer(scan.totalSpace);
 
-            displayScanResults(initialScan);
+            displayScanResults(scan);
+            Summary::printPhases(instrument::snapshot());
+            if (scan.directoriesReused > 0)
+            {
+                std::cout << "Unchanged directories reused from index: " << scan.directoriesReused
+                          << " of " << files.directoryCount() << "\n";
+            }
+            if (!indexPath.empty())
+            {
+                ScanIndex::save(indexPath, scan, hashOptions.fastHash, hashOptions.strongHash);
+            }
 
             std::cout << "\nFile Types Found:\n";
             std::map<std::string, int> typeCount;
-            for (const auto &file : files)
+            for (auto file : files)
             {
-                typeCount[file.type]++;
+                typeCount[std::string(file.type())]++;
             }
 
             for (const auto &pair : typeCount)
@@ -145,28 +237,30 @@ int main()
             std::cout << "\n[DUPLICATE FINDER]\n";
             std::cout << "Analyzing files for duplicates...\n";
 
-            ScanResult beforeDuplicates = currentState;
+            ScanTotals beforeDuplicates = currentTotals;
+            auto phasesBefore = instrument::snapshot();
 
-            handleDuplicates(files);
+            handleDuplicates(files, hashOptions);
 
-            currentState.files = files;
-            currentState.usedSpace = 0;
-            for (const auto &file : files)
+            if (!indexPath.empty())
             {
-                currentState.usedSpace += file.size / (1024.0 * 1024.0);
+                // Persist the hashes computed during the duplicate scan
+                ScanIndex::save(indexPath, scan, hashOptions.fastHash, hashOptions.strongHash);
             }
-            currentState.freeSpace = currentState.totalSpace - currentState.usedSpace;
+            currentTotals = recount(scan);
 
-            int filesRemoved = beforeDuplicates.files.size() - files.size();
+            int filesRemoved = beforeDuplicates.files - files.size();
             totalFilesProcessed += filesRemoved;
 
             if (filesRemoved > 0)
             {
-                Summary::printStep("Duplicate Removal", beforeDuplicates, currentState, filesRemoved);
+                Summary::printStep("Duplicate Removal", beforeDuplicates, currentTotals, filesRemoved,
+                                   instrument::since(phasesBefore));
             }
             else
             {
                 std::cout << "No duplicates found.\n";
+                Summary::printPhases(instrument::since(phasesBefore));
             }
 
             duplicatesHandled = true;
@@ -194,24 +288,24 @@ int main()
             std::cout << "\n[FILE OPTIMIZER]\n";
             std::cout << "Using Advanced Knapsack Algorithm for Ranking\n";
 
-            ScanResult beforeOptimization = currentState;
+            ScanTotals beforeOptimization = currentTotals;
+            auto phasesBefore = instrument::snapshot();
 
-            opt->optimizeFiles(files);
+            optimizeFiles(*opt, files);
 
-            currentState.files = files;
-            currentState.usedSpace = 0;
-            for (const auto &file : files)
-            {
-                currentState.usedSpace += file.size / (1024.0 * 1024.0);
-            }
-            currentState.freeSpace = currentState.totalSpace - currentState.usedSpace;
+            currentTotals = recount(scan);
 
-            int filesOptimized = beforeOptimization.files.size() - files.size();
+            int filesOptimized = beforeOptimization.files - files.size();
             totalFilesProcessed += filesOptimized;
 
             if (filesOptimized > 0)
             {
-                Summary::printStep("File Optimization", beforeOptimization, currentState, filesOptimized);
+                Summary::printStep("File Optimization", beforeOptimization, currentTotals, filesOptimized,
+                                   instrument::since(phasesBefore));
+            }
+            else
+            {
+                Summary::printPhases(instrument::since(phasesBefore));
             }
 
             isOptimized = true;
@@ -251,21 +345,49 @@ int main()
                 break;
             }
 
-            FileInfo &selectedFile = files[fileNum - 1];
-            std::string inputPath = selectedFile.path;
+            FileTable::Id selectedFile = fileNum - 1;
+            uintmax_t originalSize = files.sizeOf(selectedFile);
+            std::string inputPath = files.path(selectedFile);
             std::string outputPath = inputPath + ".huff";
 
-            std::cout << "Compressing: " << selectedFile.name << "\n";
-            std::cout << "Original size: " << formatSizeMB(selectedFile.size) << " MB\n";
+            std::cout << "Compressing: " << files.name(selectedFile) << "\n";
+            std::cout << "Original size: " << formatSizeMB(originalSize) << " MB\n";
+
+            CompressionEstimate estimate;
+            if (estimateFileCompression(inputPath, estimate, true) && estimate.size > 0)
+            {
+                std::cout << "Estimated size: " << formatSizeMB(estimate.predictedSize) << " MB with "
+                          << estimate.codec << " (" << std::fixed << std::setprecision(2) << estimate.entropy
+                          << " bits/byte)\n";
+                if (estimate.ratio() >= optimizer::COMPRESS_THRESHOLD)
+                {
+                    std::cout << "This file looks incompressible. Compress anyway? (y/n): ";
+                    char answer;
+                    std::cin >> answer;
+                    std::cin.ignore();
+                    if (answer != 'y' && answer != 'Y')
+                    {
+                        waitForInput();
+                        break;
+                    }
+                }
+            }
 
             try
             {
-                compressFile(inputPath, outputPath);
-                
+                HuffmanOptions options;
+                options.codec = "auto";
+                HuffmanStats stats = compressFile(inputPath, outputPath, options);
+                std::cout << "File compressed to " << outputPath << " with " << stats.codec << " ("
+                          << std::fixed << std::setprecision(1)
+                          << (stats.seconds > 0 ? stats.inputBytes / (1024.0 * 1024.0) / stats.seconds : 0.0)
+                          << " MB/s on " << stats.threads << " threads)\n";
+
+
                 if (std::filesystem::exists(outputPath))
                 {
                     uintmax_t compressedSize = std::filesystem::file_size(outputPath);
-                    double compressionRatio = ((double)(selectedFile.size - compressedSize) / selectedFile.size) * 100;
+                    double compressionRatio = ((double)(originalSize - compressedSize) / originalSize) * 100;
 
                     std::cout << "SUCCESS: Compression completed!\n";
                     std::cout << "Compressed size: " << formatSizeMB(compressedSize) << " MB\n";
@@ -283,9 +405,8 @@ int main()
                         std::filesystem::remove(inputPath);
                         std::cout << "Original file deleted.\n";
 
-                        selectedFile.path = outputPath;
-                        selectedFile.name = selectedFile.name + ".huff";
-                        selectedFile.size = compressedSize;
+                        files.rename(selectedFile, std::string(files.name(selectedFile)) + ".huff");
+                        files.setSize(selectedFile, compressedSize);
                     }
                 }
                 else
@@ -314,10 +435,10 @@ int main()
             std::cout << "\n[COMPLETE SUMMARY REPORT]\n";
             std::cout << "=========================================\n";
 
-            double spaceSaved = initialScan.usedSpace - currentState.usedSpace;
-            double percentageSaved = (spaceSaved / initialScan.usedSpace) * 100;
+            double spaceSaved = initialTotals.usedSpace - currentTotals.usedSpace;
+            double percentageSaved = (spaceSaved / initialTotals.usedSpace) * 100;
 
-            Summary::printFinal(initialScan, currentState, totalFilesProcessed);
+            Summary::printFinal(initialTotals, currentTotals, totalFilesProcessed, instrument::snapshot());
 
             std::cout << "\nOPTIMIZATION STATISTICS:\n";
             std::cout << "Space Saved: " << std::fixed << std::setprecision(2)
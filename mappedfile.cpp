@@ -0,0 +1,80 @@
+#include "mappedfile.h"
+#include <fstream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPEDFILE_HAVE_MMAP 1
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        mapping = other.mapping;
+        fallback = std::move(other.fallback);
+        length = other.length;
+        opened = other.opened;
+        other.mapping = nullptr;
+        other.length = 0;
+        other.opened = false;
+    }
+    return *this;
+}
+
+bool MappedFile::open(const std::string& path, Access access) {
+    close();
+
+#ifdef MAPPEDFILE_HAVE_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, static_cast<size_t>(st.st_size), access == Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+            mapping = static_cast<unsigned char*>(p);
+            length = static_cast<size_t>(st.st_size);
+            opened = true;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+#else
+    (void)access;
+#endif
+
+    return readAll(path);
+}
+
+void MappedFile::close() {
+#ifdef MAPPEDFILE_HAVE_MMAP
+    if (mapping) munmap(mapping, length);
+#endif
+    mapping = nullptr;
+    fallback.clear();
+    fallback.shrink_to_fit();
+    length = 0;
+    opened = false;
+}
+
+bool MappedFile::readAll(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        fallback.insert(fallback.end(), buffer, buffer + in.gcount());
+    }
+    length = fallback.size();
+    opened = true;
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read-only view of a whole file. Regular files are mapped with mmap and the
+// kernel is told the expected access pattern; anything that can't be mapped
+// (pipes, procfs, non-POSIX builds) is read into memory instead.
+class MappedFile {
+public:
+    enum Access { Sequential, Random };
+
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path, Access access = Sequential) { open(path, access); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const std::string& path, Access access = Sequential);
+    void close();
+
+    bool isOpen() const { return opened; }
+    bool isMapped() const { return mapping != nullptr; }
+    const unsigned char* data() const { return mapping ? mapping : fallback.data(); }
+    size_t size() const { return length; }
+
+private:
+    unsigned char* mapping = nullptr;
+    std::vector<unsigned char> fallback;
+    size_t length = 0;
+    bool opened = false;
+
+    bool readAll(const std::string& path);
+};
+
+#endif
@@ -1,163 +1,268 @@
 #include "optimizer.h"
-#include <iostream>
+#include "entropy.h"
+#include "threadpool.h"
+#include "batchcompress.h"
+#include "instrument.h"
+#include "batchreader.h"
 #include <algorithm>
-#include <filesystem>
+#include <cstdint>
 
-namespace fs = std::filesystem;
+optimizer::optimizer(double size, size_t memoryBudget) : totalSpace(size), memoryBudget(memoryBudget) {}
 
-optimizer::optimizer(double size) : totalSpace(size) {}
-
-void optimizer::optimizeFiles(std::vector<FileInfo>& files) {
-    std::vector<FileInfo> ranked = rankFilesKnapsack(files);
-    
-    if (ranked.empty()) {
-        std::cout << "No files available for optimization." << std::endl;
-        return;
+bool optimizer::shouldCompress(const FileTable& files, FileTable::Id id, const RankingReport* ranking) {
+    if (files.type(id) == ".huff" || files.sizeOf(id) == 0) return false;
+    CompressionEstimate estimate;
+    if (ranking && id < ranking->ratios.size()) {
+        if (ranking->ratios[id] < COMPRESS_THRESHOLD) return true;
+    } else {
+        if (!estimateFileCompression(files.path(id), estimate) || estimate.size == 0) return false;
+        if (estimate.ratio() < COMPRESS_THRESHOLD) return true;
     }
-    
-    std::cout << "\n=== Optimized file ranking (Knapsack) ===" << std::endl;
-    for (size_t i = 0; i < ranked.size(); ++i) {
-        std::cout << i + 1 << ". " << ranked[i].name 
-                  << " (" << ranked[i].size / (1024.0 * 1024.0) << " MB)" << std::endl;
+    // Inconclusive from the histogram: repeats may still compress
+    return estimateFileCompression(files.path(id), estimate, true) && estimate.ratio() < COMPRESS_THRESHOLD;
+}
+
+// Predicted compressed/original size of every file, sampled in parallel.
+// Files too small to gain anything count as incompressible. Files the
+// estimate reads whole anyway are fetched in batches through a BatchReader,
+// many at a time, and estimated from memory; larger ones are sampled
+// through a mapping.
+static std::vector<double> estimateRatios(const FileTable& files, const ProgressCallback& progress) {
+    const size_t minSize = 4096, chunk = 256, batchFiles = 4096, batchBytes = 32 * 1024 * 1024;
+    std::vector<double> ratio(files.size(), 1.0);
+    ProgressReporter reporter(progress, "estimate", files.size());
+    instrument::PhaseTimer timer(instrument::Phase::Estimate);
+
+    std::vector<FileTable::Id> small, large;
+    for (FileTable::Id id = 0; id < files.size(); ++id) {
+        if (files.sizeOf(id) < minSize || files.type(id) == ".huff") continue;
+        (files.sizeOf(id) <= WHOLE_SAMPLE_LIMIT ? small : large).push_back(id);
     }
-    
-    int choice;
-    while (true) {
-        std::cout << "\nEnter the rank of the file you want to proceed with (1-" 
-                  << ranked.size() << ", 0 to exit): ";
-        std::cin >> choice;
-        
-        if (choice == 0) {
-            std::cout << "Exiting..." << std::endl;
-            return;
+    reporter.advance(files.size() - small.size() - large.size());
+
+    auto record = [&](size_t i, const CompressionEstimate& estimate) {
+        ratio[i] = std::min(estimate.ratio(), 1.0);
+        instrument::addBytes(instrument::Phase::Estimate, estimate.sampledBytes);
+        instrument::addFiles(instrument::Phase::Estimate, 1);
+    };
+
+    ThreadPool pool;
+    BatchReader reader;
+    std::vector<unsigned char> arena;
+    for (size_t begin = 0; begin < small.size();) {
+        std::vector<ReadRequest> requests;
+        std::vector<size_t> offset;
+        size_t total = 0;
+        for (; begin < small.size() && requests.size() < batchFiles; ++begin) {
+            uint64_t size = files.sizeOf(small[begin]);
+            if (!requests.empty() && total + size > batchBytes) break;
+            ReadRequest request;
+            request.path = files.path(small[begin]);
+            request.size = request.head = size;
+            requests.push_back(std::move(request));
+            offset.push_back(total);
+            total += size;
         }
-        
-        if (choice < 1 || choice > static_cast<int>(ranked.size())) {
-            std::cout << "Invalid choice. Please enter a number between 1 and " 
-                      << ranked.size() << std::endl;
-            continue;
+        size_t batchStart = begin - requests.size();
+
+        // Each call copies into its own range of the arena
+        arena.resize(total);
+        std::vector<size_t> length(requests.size(), 0);
+        std::vector<char> readable(requests.size(), 0);
+        reader.read(requests, [&](size_t k, const unsigned char* data, size_t size, int error) {
+            if (error) return;
+            std::copy(data, data + size, arena.data() + offset[k]);
+            length[k] = size;
+            readable[k] = 1;
+        });
+
+        for (size_t first = 0; first < requests.size(); first += chunk) {
+            pool.submit([&, first] {
+                instrument::TraceScope trace("estimate-chunk");
+                size_t last = std::min(first + chunk, requests.size());
+                for (size_t k = first; k < last; ++k) {
+                    if (!readable[k]) continue;
+                    record(small[batchStart + k], estimateCompression(arena.data() + offset[k], length[k]));
+                }
+                reporter.advance(last - first);
+            });
         }
-        
-        break;
+        pool.wait();
     }
-    
-    FileInfo selected = ranked[choice - 1];
-    
-    if (shouldCompress(selected)) {
-        std::cout << "File " << selected.name << " is a text file." << std::endl;
-        std::cout << "Options:\n1. Delete\n2. Compress" << std::endl;
-        int action;
-        std::cin >> action;
-        
-        if (action == 1) {
-            deleteFile(selected);
-        } else if (action == 2) {
-            compressFile(selected);
-        } else {
-            std::cout << "Invalid option." << std::endl;
-        }
-    } else {
-        std::cout << "File " << selected.name << " is NOT a text file." << std::endl;
-        std::cout << "Options:\n1. Delete" << std::endl;
-        int action;
-        std::cin >> action;
-        
-        if (action == 1) {
-            deleteFile(selected);
-        } else {
-            std::cout << "Invalid option." << std::endl;
+
+    for (size_t first = 0; first < large.size(); first += chunk) {
+        pool.submit([&, first] {
+            instrument::TraceScope trace("estimate-chunk");
+            size_t last = std::min(first + chunk, large.size());
+            for (size_t k = first; k < last; ++k) {
+                CompressionEstimate estimate;
+                if (estimateFileCompression(files.path(large[k]), estimate)) record(large[k], estimate);
+            }
+            reporter.advance(last - first);
+        });
+    }
+    pool.wait();
+    return ratio;
+}
+
+std::vector<BatchCompressResult> optimizer::compressFiles(FileTable& files, const std::vector<FileTable::Id>& ids,
+                                                         const ProgressCallback& progress) {
+    BatchCompressOptions options;
+    options.huffman.codec = "auto";
+    options.progress = progress;
+    std::vector<BatchCompressResult> results = compressBatch(files, ids, options);
+    for (const BatchCompressResult& r : results) {
+        if (r.replaced) {
+            files.rename(r.id, std::string(files.name(r.id)) + ".huff");
+            files.setSize(r.id, r.stats.outputBytes);
         }
     }
+    return results;
 }
 
-bool optimizer::shouldCompress(const FileInfo& file) {
-    std::string ext = fs::path(file.name).extension().string();
-    return (ext == ".txt" || ext == ".log" || ext == ".csv" || ext == ".cpp" || ext == ".h");
+double optimizer::fileValue(const FileTable& files, FileTable::Id id, double ratio) const {
+    double sizeScore = files.sizeOf(id) / (1024.0 * 1024.0); // Size in MB
+    double ageScore = (files.lastModified(id) + 1) * 0.1;  // Age factor (newer = lower score)
+
+    // Type-based scoring
+    double typeScore = 1.0;
+    std::string_view type = files.type(id);
+    if (type == ".tmp" || type == ".log") {
+        typeScore = 3.0; // Higher priority for temp/log files
+    } else if (type == ".bak" || type == ".old") {
+        typeScore = 2.5; // High priority for backup files
+    } else if (type == ".cache") {
+        typeScore = 2.0; // Medium priority for cache files
+    }
+
+    // Space compression would give back, in MB
+    double compressScore = sizeScore * (1.0 - ratio);
+
+    return sizeScore * typeScore + ageScore + compressScore; // Combined value
 }
 
-void optimizer::deleteFile(FileInfo& file) {
-    try {
-        fs::remove(file.path);
-        std::cout << "Deleted: " << file.name << std::endl;
-    } catch (const std::exception& e) {
-        std::cerr << "Error deleting " << file.name << ": " << e.what() << std::endl;
+// Exact 0/1 knapsack: one rolling DP row plus one bit per (file, capacity)
+// recording whether the file was taken, used to reconstruct the choice.
+static std::vector<bool> knapsackExact(const std::vector<uint64_t>& wt, const std::vector<double>& val, uint64_t W) {
+    size_t n = wt.size();
+    size_t row = static_cast<size_t>(W + 1);
+    std::vector<double> dp(row, 0.0);
+    std::vector<uint64_t> taken((n * row + 63) / 64, 0);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (wt[i] > W) continue;
+        for (size_t w = row - 1; w >= wt[i]; --w) {
+            double with = dp[w - wt[i]] + val[i];
+            if (with > dp[w]) {
+                dp[w] = with;
+                size_t bit = i * row + w;
+                taken[bit / 64] |= uint64_t(1) << (bit % 64);
+            }
+        }
+    }
+
+    std::vector<bool> chosen(n, false);
+    size_t w = row - 1;
+    for (size_t i = n; i-- > 0;) {
+        size_t bit = i * row + w;
+        if (taken[bit / 64] >> (bit % 64) & 1) {
+            chosen[i] = true;
+            w -= wt[i];
+        }
     }
+    return chosen;
 }
 
-void optimizer::compressFile(FileInfo& file) {
-    std::cout << "Compressing " << file.name << "..." << std::endl;
-    // This is handled in main.cpp case 4 now
+// Greedy by value density, compared against the best single file; the result
+// is at least half the optimum. Also returns the fractional (LP) optimum,
+// which bounds the true optimum from above.
+static std::vector<bool> knapsackGreedy(const std::vector<uint64_t>& wt, const std::vector<double>& val, uint64_t W,
+                                        double& upperBound) {
+    size_t n = wt.size();
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return val[a] * wt[b] > val[b] * wt[a];
+    });
+
+    std::vector<bool> chosen(n, false);
+    uint64_t used = 0;
+    double greedyValue = 0.0;
+    upperBound = 0.0;
+    bool fractionTaken = false;
+    for (size_t i : order) {
+        if (used + wt[i] <= W) {
+            chosen[i] = true;
+            used += wt[i];
+            greedyValue += val[i];
+            if (!fractionTaken) upperBound += val[i];
+        } else if (!fractionTaken) {
+            upperBound += val[i] * double(W - used) / double(wt[i]);
+            fractionTaken = true;
+        }
+    }
+
+    size_t best = n;
+    for (size_t i = 0; i < n; ++i) {
+        if (wt[i] <= W && (best == n || val[i] > val[best])) best = i;
+    }
+    if (best != n && val[best] > greedyValue) {
+        chosen.assign(n, false);
+        chosen[best] = true;
+    }
+    return chosen;
 }
 
-// FIXED RANKING FUNCTION
-std::vector<FileInfo> optimizer::rankFilesKnapsack(const std::vector<FileInfo>& files) {
-    int n = files.size();
-    std::cout << "\nDEBUG: Ranking " << n << " files" << std::endl;
-    std::cout << "Total Space: " << totalSpace << " MB" << std::endl;
-    
+std::vector<FileTable::Id> optimizer::rankFilesKnapsack(const FileTable& files, RankingReport* report,
+                                                        const ProgressCallback& progress) {
+    RankingReport local;
+    RankingReport& rep = report ? *report : local;
+    rep = RankingReport();
+
+    size_t n = files.size();
     if (n == 0) return {};
     
-    // Convert totalSpace from MB to KB for reasonable capacity
-    int W = static_cast<int>(totalSpace * 1024); // MB to KB
-    if (W > 100000) W = 100000; // Cap at 100GB in KB to prevent memory issues
-    
-    std::vector<std::vector<double>> dp(n + 1, std::vector<double>(W + 1, 0));
+    // Capacity and weights in KB
+    uint64_t W = static_cast<uint64_t>(totalSpace * 1024);
     
-    // Show first few files for debugging
-    for (size_t i = 0; i < std::min((size_t)3, files.size()); ++i) {
-        std::cout << "File " << i << ": " << files[i].name 
-                  << " Size: " << files[i].size / (1024.0 * 1024.0) << " MB"
-                  << " Age: " << files[i].lastModified << " days" << std::endl;
+    std::vector<uint64_t> wt(n);
+    std::vector<double> val(n);
+    rep.ratios = estimateRatios(files, progress);
+    const std::vector<double>& ratio = rep.ratios;
+    instrument::PhaseTimer timer(instrument::Phase::Rank);
+    instrument::addFiles(instrument::Phase::Rank, n);
+    uint64_t totalWeight = 0;
+    for (size_t i = 0; i < n; ++i) {
+        wt[i] = std::max<uint64_t>(files.sizeOf(i) / 1024, 1); // Minimum weight of 1KB
+        val[i] = fileValue(files, i, ratio[i]);
+        totalWeight += wt[i];
     }
-    
-    // Improved value and weight calculation
-    for (int i = 1; i <= n; ++i) {
-        // Convert file size to KB for consistent units
-        int wt = static_cast<int>(files[i - 1].size / 1024); // Size in KB
-        if (wt == 0) wt = 1; // Minimum weight of 1KB
-        
-        // Better value function: combine multiple factors
-        double sizeScore = files[i - 1].size / (1024.0 * 1024.0); // Size in MB
-        double ageScore = (files[i - 1].lastModified + 1) * 0.1;  // Age factor (newer = lower score)
-        
-        // Type-based scoring
-        double typeScore = 1.0;
-        if (files[i - 1].type == ".tmp" || files[i - 1].type == ".log") {
-            typeScore = 3.0; // Higher priority for temp/log files
-        } else if (files[i - 1].type == ".bak" || files[i - 1].type == ".old") {
-            typeScore = 2.5; // High priority for backup files
-        } else if (files[i - 1].type == ".cache") {
-            typeScore = 2.0; // Medium priority for cache files
-        }
-        
-        double val = sizeScore * typeScore + ageScore; // Combined value
-        
-        for (int w = 0; w <= W; ++w) {
-            if (wt <= w) {
-                dp[i][w] = std::max(dp[i - 1][w], dp[i - 1][w - wt] + val);
-            } else {
-                dp[i][w] = dp[i - 1][w];
-            }
-        }
+
+    // Pick the cheapest method that still gives a sound answer
+    std::vector<bool> selected;
+    size_t exactBytes = (W + 1) * sizeof(double) + (n * (W + 1) + 7) / 8;
+    rep.memoryBudget = memoryBudget;
+    if (totalWeight <= W) {
+        rep.method = "all-fit";
+        selected.assign(n, true);
+    } else if (W < SIZE_MAX / n && exactBytes <= memoryBudget) {
+        rep.method = "exact-dp";
+        rep.memoryBytes = exactBytes;
+        selected = knapsackExact(wt, val, W);
+    } else {
+        rep.method = "greedy";
+        rep.memoryBytes = n * sizeof(size_t);
+        selected = knapsackGreedy(wt, val, W, rep.upperBound);
     }
-    
-    // Reconstruct solution (which files were selected)
-    int w = W;
-    std::vector<FileInfo> chosen;
-    std::vector<bool> selected(n, false);
-    
-    for (int i = n; i > 0 && w > 0; i--) {
-        if (dp[i][w] != dp[i - 1][w]) {
-            chosen.push_back(files[i - 1]);
-            selected[i - 1] = true;
-            w -= static_cast<int>(files[i - 1].size / 1024);
+
+    std::vector<FileTable::Id> chosen;
+    for (size_t i = 0; i < n; ++i) {
+        if (selected[i]) {
+            chosen.push_back(static_cast<FileTable::Id>(i));
+            rep.value += val[i];
         }
     }
-    
-    // Reverse to show in selection order (preserve knapsack ranking)
-    std::reverse(chosen.begin(), chosen.end());
-    
-    std::cout << "Knapsack selected " << chosen.size() << " files for optimization" << std::endl;
+    if (rep.upperBound == 0.0) rep.upperBound = rep.value; // exact methods
     
     return chosen;
 }
@@ -3,27 +3,57 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
 #include "scanner.h"
+#include "batchcompress.h"
+#include "progress.h"
+
+// How rankFilesKnapsack reached its answer
+struct RankingReport
+{
+    std::string method;      // "all-fit", "exact-dp" or "greedy"
+    size_t memoryBytes = 0;  // working memory of the chosen method
+    size_t memoryBudget = 0;
+    double value = 0.0;      // total value of the selected files
+    double upperBound = 0.0; // bound on the optimum (== value when exact)
+    std::vector<double> ratios; // predicted compressed/original size by row id
+};
 
 class optimizer
 {
 public:
-    optimizer(double size);
+    // memoryBudget caps the exact knapsack DP; beyond it ranking falls back
+    // to a greedy approximation with a reported error bound
+    optimizer(double size, size_t memoryBudget = 256 * 1024 * 1024);
 
-    void optimizeFiles(std::vector<FileInfo> &files);
+    double capacity() const { return totalSpace; } // knapsack capacity in MB
 
-private:
-    double totalSpace;
+    // DP-based knapsack ranking; returns row ids. progress counts files
+    // sampled in the "estimate" phase.
+    std::vector<FileTable::Id> rankFilesKnapsack(const FileTable &files, RankingReport *report = nullptr,
+                                                 const ProgressCallback &progress = nullptr);
 
-    // New: DP-based knapsack ranking
-    std::vector<FileInfo> rankFilesKnapsack(const std::vector<FileInfo> &files);
+    // True when the sampled content predicts a .huff file below
+    // COMPRESS_THRESHOLD of the original, whatever the extension. Files the
+    // histogram alone does not clear get the codec trial as well. With the
+    // report of a ranking of files, its estimate is reused instead of
+    // sampling the file again.
+    bool shouldCompress(const FileTable &files, FileTable::Id id, const RankingReport *ranking = nullptr);
 
-    // Only need shouldCompress (for text files)
-    bool shouldCompress(const FileInfo &file);
+    static constexpr double COMPRESS_THRESHOLD = 0.9;
+
+    // Compress the given rows in parallel (compressBatch) with the "auto"
+    // codec, replacing each original with its verified .huff and updating
+    // the table to match. Per-file outcomes come back in the order of ids.
+    std::vector<BatchCompressResult> compressFiles(FileTable &files, const std::vector<FileTable::Id> &ids,
+                                                   const ProgressCallback &progress = nullptr);
+
+private:
+    double totalSpace;
+    size_t memoryBudget;
 
-    // File operations
-    void deleteFile(FileInfo &file);
-    void compressFile(FileInfo &file); // Will internally call Huffman
+    // ratio is the predicted compressed/original size (1.0 = incompressible)
+    double fileValue(const FileTable &files, FileTable::Id id, double ratio) const;
 };
 
 #endif
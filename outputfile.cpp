@@ -0,0 +1,110 @@
+#include "outputfile.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+std::string createTempFor(const std::string& path) {
+#ifdef __linux__
+    std::string name = path + ".XXXXXX.tmp";
+    std::vector<char> buffer(name.begin(), name.end());
+    buffer.push_back('\0');
+    int fd = mkstemps(buffer.data(), 4); // O_EXCL, mode 0600
+    if (fd < 0) return "";
+    close(fd);
+    return buffer.data();
+#else
+    static const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    std::random_device seed;
+    std::mt19937 random(seed());
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        std::string name = path + ".";
+        for (int i = 0; i < 6; ++i) name += DIGITS[random() % 36];
+        name += ".tmp";
+        FILE* file = std::fopen(name.c_str(), "wbx"); // fails if the name is taken
+        if (!file) {
+            if (errno == EEXIST) continue;
+            return "";
+        }
+        std::fclose(file);
+        std::error_code ec;
+        fs::permissions(name, fs::perms::owner_read | fs::perms::owner_write, ec);
+        return name;
+    }
+    errno = EEXIST;
+    return "";
+#endif
+}
+
+int publishFile(const std::string& temp, const std::string& path, bool replace) {
+#ifdef __linux__
+    if (replace) return rename(temp.c_str(), path.c_str()) == 0 ? 0 : errno;
+    if (renameat2(AT_FDCWD, temp.c_str(), AT_FDCWD, path.c_str(), RENAME_NOREPLACE) == 0) return 0;
+    if (errno != EINVAL && errno != ENOSYS) return errno;
+    // No RENAME_NOREPLACE on this filesystem: link() fails on an existing name too
+    if (link(temp.c_str(), path.c_str()) != 0) return errno;
+    unlink(temp.c_str());
+    return 0;
+#else
+    std::error_code ec;
+    if (!replace && fs::exists(fs::symlink_status(path, ec))) return EEXIST;
+    fs::rename(temp, path, ec);
+    return ec ? ec.value() : 0;
+#endif
+}
+
+bool copyMetadata(const std::string& original, const std::string& copy, std::string& error) {
+#ifdef __linux__
+    struct stat st;
+    if (stat(original.c_str(), &st) != 0) {
+        error = "cannot stat " + original + ": " + std::strerror(errno);
+        return false;
+    }
+    int fd = open(copy.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "cannot open " + copy + ": " + std::strerror(errno);
+        return false;
+    }
+    mode_t mode = st.st_mode & 07777;
+    if (fchown(fd, st.st_uid, st.st_gid) != 0) mode &= 0700;
+    bool ok = fchmod(fd, mode) == 0;
+    if (ok) {
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        ok = futimens(fd, times) == 0;
+    }
+    if (!ok) error = "cannot copy permissions to " + copy + ": " + std::strerror(errno);
+    close(fd);
+    return ok;
+#else
+    std::error_code ec;
+    fs::perms perms = fs::status(original, ec).permissions();
+    if (!ec) fs::permissions(copy, perms, ec);
+    if (!ec) fs::last_write_time(copy, fs::last_write_time(original, ec), ec);
+    if (ec) error = "cannot copy permissions to " + copy + ": " + ec.message();
+    return !ec;
+#endif
+}
+
+void useDefaultMode(const std::string& path) {
+#ifdef __linux__
+    mode_t mask = umask(0);
+    umask(mask);
+    chmod(path.c_str(), 0666 & ~mask);
+#else
+    std::error_code ec;
+    fs::permissions(path, fs::perms::owner_read | fs::perms::owner_write | fs::perms::group_read |
+                    fs::perms::others_read, ec);
+#endif
+}
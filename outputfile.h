@@ -0,0 +1,30 @@
+#ifndef OUTPUTFILE_H
+#define OUTPUTFILE_H
+
+#include <string>
+
+// Writing a new file without ever truncating or replacing one that is
+// already there: the data goes to a private temporary next to the target,
+// which is then moved into place in one step.
+
+// Create an empty file next to path, readable by its owner only, under a
+// name no other file has (path + ".XXXXXX.tmp"). Returns its name, or "" with
+// errno set.
+std::string createTempFor(const std::string& path);
+
+// Move temp to path. Unless replace is set this fails with EEXIST when path
+// exists, checked atomically with the move where the system allows it.
+// Returns 0 or an errno value; temp is left in place on failure.
+int publishFile(const std::string& temp, const std::string& path, bool replace = false);
+
+// Give copy the original's mode, owner and timestamps. If the owner cannot
+// be copied the copy stays private to its creator rather than opening the
+// original's group or other bits to the wrong owner. On failure returns
+// false and describes the problem in error.
+bool copyMetadata(const std::string& original, const std::string& copy, std::string& error);
+
+// Give a temporary the mode a newly created file gets (0666 less the umask),
+// for outputs with no original to copy from
+void useDefaultMode(const std::string& path);
+
+#endif
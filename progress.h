@@ -0,0 +1,42 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// How far a long-running core call has got. phase names the stage ("scan",
+// "partial-hash", ...); total is 0 when it is not known in advance.
+struct Progress {
+    const char* phase = "";
+    uint64_t done = 0;
+    uint64_t total = 0;
+};
+
+// Called from worker threads, one call at a time. It must not throw and
+// should return quickly: the worker reporting waits for it.
+using ProgressCallback = std::function<void(const Progress&)>;
+
+// Shared counter for one phase; advance() is safe from any thread and free
+// when nobody listens. Reports are serialized, so done only ever grows.
+class ProgressReporter {
+public:
+    ProgressReporter(const ProgressCallback& callback, const char* phase, uint64_t total = 0)
+        : callback(callback), phase(phase), total(total) {}
+
+    void advance(uint64_t n = 1) {
+        if (!callback) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        done += n;
+        callback(Progress{phase, done, total});
+    }
+
+private:
+    const ProgressCallback& callback;
+    const char* phase;
+    uint64_t total;
+    uint64_t done = 0;
+    std::mutex mutex;
+};
+
+#endif
@@ -0,0 +1,269 @@
+#include "scanindex.h"
+#include "hasher.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+struct ScanIndex::Header {
+    char magic[4];
+    uint32_t version;
+    int64_t createdNs;
+    uint64_t dirCount;
+    uint64_t fileCount;
+    uint64_t childCount;
+    uint64_t stringBytes;
+    char fastHash[8];
+    char strongHash[8];
+};
+
+namespace {
+
+const char INDEX_MAGIC[4] = {'S', 'M', 'S', 'I'};
+const uint32_t INDEX_VERSION = 1;
+
+static_assert(sizeof(ScanIndex::DirRecord) == 40, "index layout");
+static_assert(sizeof(ScanIndex::FileRecord) == 80, "index layout");
+
+void copyName(char out[8], const std::string& name) {
+    std::memset(out, 0, 8);
+    std::memcpy(out, name.data(), std::min<size_t>(name.size(), 8));
+}
+
+bool sameName(const char stored[8], const std::string& name) {
+    char expected[8];
+    copyName(expected, name);
+    return name.size() <= 8 && std::memcmp(stored, expected, 8) == 0;
+}
+
+} // namespace
+
+bool ScanIndex::load(const std::string& path, const std::string& fastHash, const std::string& strongHash) {
+    header = nullptr;
+    if (!file.open(path, MappedFile::Random) || file.size() < sizeof(Header)) return false;
+
+    const auto* h = reinterpret_cast<const Header*>(file.data());
+    if (std::memcmp(h->magic, INDEX_MAGIC, 4) != 0 || h->version != INDEX_VERSION) return false;
+
+    uint64_t expected = sizeof(Header) + h->dirCount * sizeof(DirRecord) + h->fileCount * sizeof(FileRecord) +
+                        h->childCount * sizeof(uint32_t) + h->stringBytes;
+    if (h->dirCount > file.size() || h->fileCount > file.size() || expected != file.size()) return false;
+
+    const unsigned char* p = file.data() + sizeof(Header);
+    dirs = reinterpret_cast<const DirRecord*>(p);
+    p += h->dirCount * sizeof(DirRecord);
+    files = reinterpret_cast<const FileRecord*>(p);
+    p += h->fileCount * sizeof(FileRecord);
+    children = reinterpret_cast<const uint32_t*>(p);
+    p += h->childCount * sizeof(uint32_t);
+    strings = reinterpret_cast<const char*>(p);
+
+    hashesValid = sameName(h->fastHash, fastHash) && sameName(h->strongHash, strongHash);
+    fastName = hashesValid ? fastHash : "";
+    strongName = hashesValid ? strongHash : "";
+    header = h;
+    return true;
+}
+
+int64_t ScanIndex::createdNs() const {
+    return header ? header->createdNs : 0;
+}
+
+std::string_view ScanIndex::text(uint64_t offset, uint32_t length) const {
+    if (offset + length > header->stringBytes) return {};
+    return std::string_view(strings + offset, length);
+}
+
+std::string ScanIndex::directoryPath(const DirRecord& dir) const {
+    return std::string(text(dir.pathOffset, dir.pathLength));
+}
+
+std::string ScanIndex::fileName(const FileRecord& record) const {
+    return std::string(text(record.nameOffset, record.nameLength));
+}
+
+const ScanIndex::DirRecord* ScanIndex::findDirectory(const std::string& path) const {
+    if (!header) return nullptr;
+
+    const DirRecord* end = dirs + header->dirCount;
+    const DirRecord* it = std::lower_bound(dirs, end, std::string_view(path),
+                                           [this](const DirRecord& d, std::string_view p) {
+                                               return text(d.pathOffset, d.pathLength) < p;
+                                           });
+    if (it == end || text(it->pathOffset, it->pathLength) != path) return nullptr;
+
+    // Reject records pointing outside the file
+    if (uint64_t(it->firstFile) + it->fileCount > header->fileCount ||
+        uint64_t(it->firstChild) + it->childCount > header->childCount) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < it->childCount; ++i) {
+        if (children[it->firstChild + i] >= header->dirCount) return nullptr;
+    }
+    return it;
+}
+
+const ScanIndex::FileRecord* ScanIndex::findFile(const DirRecord& dir, const char* name) const {
+    const FileRecord* begin = files + dir.firstFile;
+    const FileRecord* end = begin + dir.fileCount;
+    std::string_view key(name);
+    const FileRecord* it = std::lower_bound(begin, end, key, [this](const FileRecord& f, std::string_view n) {
+        return text(f.nameOffset, f.nameLength) < n;
+    });
+    if (it == end || text(it->nameOffset, it->nameLength) != key) return nullptr;
+    return it;
+}
+
+void ScanIndex::restoreHashes(const FileRecord& record, FileTable& table, FileTable::Id id) const {
+    if (!hashesValid) return;
+    if (record.hashLength && record.hashLength <= sizeof(record.hash)) {
+        Digest<16>& d = table.fastDigest(id);
+        d.length = record.hashLength;
+        std::memcpy(d.bytes, record.hash, record.hashLength);
+    }
+    if (record.strongHashLength && record.strongHashLength <= sizeof(record.strongHash)) {
+        Digest<32>& d = table.strongDigest(id);
+        d.length = record.strongHashLength;
+        std::memcpy(d.bytes, record.strongHash, record.strongHashLength);
+    }
+}
+
+bool ScanIndex::save(const std::string& path, const ScanResult& result,
+                     const std::string& fastHash, const std::string& strongHash) {
+    const FileTable& table = result.files;
+    // Digests are only written under the name of the algorithm that made them
+    const bool fastValid = !fastHash.empty() && table.fastHashName() == fastHash;
+    const bool strongValid = !strongHash.empty() && table.strongHashName() == strongHash;
+
+    // Directories sorted by path, with each one's index
+    std::vector<std::string> dirPaths(table.directoryCount());
+    std::vector<uint32_t> order(dirPaths.size());
+    for (FileTable::Id d = 0; d < dirPaths.size(); ++d) {
+        dirPaths[d] = table.directoryPath(d);
+        order[d] = d;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return dirPaths[a] < dirPaths[b]; });
+
+    std::vector<uint32_t> dirIndex(dirPaths.size()); // table directory id -> record index
+    std::unordered_map<std::string, uint32_t> indexByPath;
+    for (size_t i = 0; i < order.size(); ++i) {
+        dirIndex[order[i]] = static_cast<uint32_t>(i);
+        indexByPath[dirPaths[order[i]]] = static_cast<uint32_t>(i);
+    }
+
+    // Files grouped by directory, sorted by name within it
+    struct Entry {
+        uint32_t dir;
+        std::string_view name;
+        FileTable::Id id;
+    };
+    std::vector<Entry> entries;
+    entries.reserve(table.size());
+    for (FileTable::Id i = 0; i < table.size(); ++i) {
+        entries.push_back({dirIndex[table.directoryOf(i)], table.name(i), i});
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.dir != b.dir ? a.dir < b.dir : a.name < b.name;
+    });
+
+    std::vector<std::vector<uint32_t>> childLists(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        const std::string& p = dirPaths[order[i]];
+        size_t slash = p.size() >= 2 ? p.rfind('/', p.size() - 2) : std::string::npos;
+        if (slash == std::string::npos) continue;
+        auto it = indexByPath.find(p.substr(0, slash + 1));
+        if (it != indexByPath.end()) childLists[it->second].push_back(static_cast<uint32_t>(i));
+    }
+
+    std::string stringBlob;
+    std::vector<DirRecord> dirRecords(order.size());
+    std::vector<uint32_t> childArray;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const std::string& dirPath = dirPaths[order[i]];
+        DirRecord& r = dirRecords[i];
+        std::memset(&r, 0, sizeof(r));
+        r.pathOffset = stringBlob.size();
+        r.pathLength = static_cast<uint32_t>(dirPath.size());
+        r.mtimeNs = table.directoryMtime(order[i]);
+        r.firstChild = static_cast<uint32_t>(childArray.size());
+        r.childCount = static_cast<uint32_t>(childLists[i].size());
+        stringBlob += dirPath;
+        childArray.insert(childArray.end(), childLists[i].begin(), childLists[i].end());
+    }
+
+    std::vector<FileRecord> fileRecords(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const Entry& e = entries[i];
+        FileRecord& r = fileRecords[i];
+        std::memset(&r, 0, sizeof(r));
+        r.nameOffset = stringBlob.size();
+        r.nameLength = static_cast<uint32_t>(e.name.size());
+        r.size = table.sizeOf(e.id);
+        r.mtimeNs = table.mtimeNs(e.id);
+        r.inode = table.inode(e.id);
+        const Digest<16>& fast = table.fastDigest(e.id);
+        if (fastValid && fast.length <= sizeof(r.hash)) {
+            r.hashLength = fast.length;
+            std::memcpy(r.hash, fast.bytes, fast.length);
+        }
+        const Digest<32>& strong = table.strongDigest(e.id);
+        if (strongValid) {
+            r.strongHashLength = strong.length;
+            std::memcpy(r.strongHash, strong.bytes, strong.length);
+        }
+        stringBlob += e.name;
+
+        DirRecord& d = dirRecords[e.dir];
+        if (d.fileCount == 0) d.firstFile = static_cast<uint32_t>(i);
+        d.fileCount++;
+    }
+
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, INDEX_MAGIC, 4);
+    h.version = INDEX_VERSION;
+    h.createdNs = result.scannedAtNs;
+    h.dirCount = dirRecords.size();
+    h.fileCount = fileRecords.size();
+    h.childCount = childArray.size();
+    h.stringBytes = stringBlob.size();
+    copyName(h.fastHash, fastHash);
+    copyName(h.strongHash, strongHash);
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(dirRecords.data()), dirRecords.size() * sizeof(DirRecord));
+        out.write(reinterpret_cast<const char*>(fileRecords.data()), fileRecords.size() * sizeof(FileRecord));
+        out.write(reinterpret_cast<const char*>(childArray.data()), childArray.size() * sizeof(uint32_t));
+        out.write(stringBlob.data(), stringBlob.size());
+        if (!out) return false;
+    }
+    fs::rename(tmp, path, ec);
+    return !ec;
+}
+
+std::string defaultIndexPath(const std::string& directory) {
+    std::string base;
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME")) {
+        base = xdg;
+    } else if (const char* home = std::getenv("HOME")) {
+        base = std::string(home) + "/.cache";
+    }
+    if (base.empty()) return "";
+
+    std::error_code ec;
+    std::string absolute = fs::weakly_canonical(fs::absolute(directory, ec), ec).string();
+    auto hasher = makeHasher("xxh64");
+    std::string key = hasher->hash(reinterpret_cast<const unsigned char*>(absolute.data()), absolute.size());
+    return base + "/storage_optimizer/" + key + ".idx";
+}
@@ -0,0 +1,95 @@
+#ifndef SCANINDEX_H
+#define SCANINDEX_H
+
+#include "scanner.h"
+#include "mappedfile.h"
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// On-disk cache of a previous scan: directories with their mtimes and child
+// lists, files with size, mtime, inode and content hashes. The file is
+// memory-mapped and searched in place (records are sorted), so loading costs
+// nothing proportional to the tree size.
+//
+// An incremental scan trusts a directory whose mtime is unchanged and reuses
+// its cached entries without listing or stat'ing it. Files rewritten in place
+// inside such a directory keep their old metadata until the directory itself
+// changes or a full scan is run.
+class ScanIndex {
+public:
+    struct DirRecord {
+        uint64_t pathOffset;
+        uint32_t pathLength; // path ends with '/'
+        uint32_t fileCount;
+        int64_t mtimeNs;
+        uint32_t firstFile;
+        uint32_t firstChild;
+        uint32_t childCount;
+        uint32_t reserved;
+    };
+
+    struct FileRecord {
+        uint64_t nameOffset;
+        uint32_t nameLength;
+        uint8_t hashLength;       // bytes of fast hash, 0 = not computed
+        uint8_t strongHashLength; // bytes of strong hash, 0 = not computed
+        uint16_t reserved;
+        uint64_t size;
+        int64_t mtimeNs;
+        uint64_t inode;
+        uint8_t hash[8];
+        uint8_t strongHash[32];
+    };
+
+    // Hashes are only restored when the index was written with the same
+    // fast/strong algorithm names. Returns false if the file is missing,
+    // from another version, or corrupt.
+    bool load(const std::string& path, const std::string& fastHash, const std::string& strongHash);
+    bool isLoaded() const { return header != nullptr; }
+
+    // Algorithm names of the digests restoreHashes() hands out ("" if none),
+    // for FileTable::setHashNames on the table they go into
+    const std::string& fastHashName() const { return fastName; }
+    const std::string& strongHashName() const { return strongName; }
+
+    // Scan start time of the indexed scan
+    int64_t createdNs() const;
+
+    const DirRecord* findDirectory(const std::string& path) const;
+    const FileRecord* findFile(const DirRecord& dir, const char* name) const;
+
+    std::string directoryPath(const DirRecord& dir) const;
+    std::string fileName(const FileRecord& file) const;
+    const FileRecord* filesOf(const DirRecord& dir) const { return files + dir.firstFile; }
+    const DirRecord& child(const DirRecord& dir, uint32_t i) const { return dirs[children[dir.firstChild + i]]; }
+
+    void restoreHashes(const FileRecord& record, FileTable& table, FileTable::Id id) const;
+
+    // Write `result` (which must come from scanDirectory) atomically to path.
+    // Digests are kept only where the table names the given algorithms.
+    static bool save(const std::string& path, const ScanResult& result,
+                     const std::string& fastHash, const std::string& strongHash);
+
+private:
+    struct Header;
+
+    MappedFile file;
+    const Header* header = nullptr;
+    const DirRecord* dirs = nullptr;
+    const FileRecord* files = nullptr;
+    const uint32_t* children = nullptr;
+    const char* strings = nullptr;
+    bool hashesValid = false;
+    std::string fastName;
+    std::string strongName;
+
+    std::string_view text(uint64_t offset, uint32_t length) const;
+};
+
+// Per-directory index location under the user's cache directory
+// ($XDG_CACHE_HOME or ~/.cache), or "" if there is none
+std::string defaultIndexPath(const std::string& directory);
+
+#endif
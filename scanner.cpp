@@ -1,7 +1,18 @@
 #include "scanner.h"
+#include "threadpool.h"
+#include "scanindex.h"
+#include "instrument.h"
 #include <filesystem>
 #include <chrono>
-#include <iostream>
+#include <ctime>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 
@@ -14,7 +25,216 @@ long long formatTime(fs::file_time_type ftime) {
     return days;
 }
 
-ScanResult scanDirectory(const std::string& directory) {
+static void fillSpaceInfo(ScanResult& result, const std::string& directory) {
+    std::error_code ec;
+
+    result.usedSpace = 0.0;
+    for (uint64_t size : result.files.sizes()) {
+        result.usedSpace += size / (1024.0 * 1024.0); // Convert bytes to MB
+    }
+
+    auto space = fs::space(directory, ec);
+    if (!ec) {
+        result.totalSpace = space.capacity / (1024.0 * 1024.0);
+        result.freeSpace = space.free / (1024.0 * 1024.0);
+    }
+}
+
+#ifdef __linux__
+
+namespace {
+
+// Layout of the records returned by getdents64
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Same rules as std::filesystem::path::extension()
+std::string extensionOf(const std::string& name) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || dot == 0 || name == "..") return "";
+    return name.substr(dot);
+}
+
+int64_t toNs(const struct timespec& ts) {
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+struct ParallelScan {
+    ThreadPool pool;
+    std::vector<FileTable> shards; // one per worker, no shared lock
+    std::vector<size_t> reused;
+    const ScanIndex* previous;
+    ProgressReporter progress;
+    time_t now;
+
+    ParallelScan(unsigned threads, const ScanIndex* previous, const ProgressCallback& callback)
+        : pool(threads), shards(pool.size()), reused(pool.size(), 0), previous(previous),
+          progress(callback, "scan"), now(time(nullptr)) {}
+
+    long long ageDays(int64_t mtimeNs) const {
+        time_t mtime = static_cast<time_t>(mtimeNs / 1000000000);
+        return mtime < now ? (now - mtime) / 86400 : 0;
+    }
+
+    void addFile(FileTable& shard, FileTable::Id dir, const char* name, const struct stat& st,
+                 const ScanIndex::DirRecord* cachedDir) {
+        uint64_t size = static_cast<uint64_t>(st.st_size);
+        int64_t mtimeNs = toNs(st.st_mtim);
+        uint64_t inode = static_cast<uint64_t>(st.st_ino);
+        FileTable::Id id = shard.addFile(dir, name, size, mtimeNs, inode, ageDays(mtimeNs));
+
+        // Same (size, mtime, inode) as last time: the cached hashes still hold
+        if (cachedDir) {
+            const ScanIndex::FileRecord* cached = previous->findFile(*cachedDir, name);
+            if (cached && cached->size == size && cached->mtimeNs == mtimeNs && cached->inode == inode) {
+                previous->restoreHashes(*cached, shard, id);
+            }
+        }
+    }
+
+    // Take an unchanged directory's files and subdirectories from the index
+    void reuseDir(FileTable& shard, FileTable::Id dirId, const ScanIndex::DirRecord& dir) {
+        int w = pool.currentWorker();
+        const ScanIndex::FileRecord* records = previous->filesOf(dir);
+        for (uint32_t i = 0; i < dir.fileCount; ++i) {
+            const ScanIndex::FileRecord& r = records[i];
+            FileTable::Id id = shard.addFile(dirId, previous->fileName(r), r.size, r.mtimeNs, r.inode,
+                                             ageDays(r.mtimeNs));
+            previous->restoreHashes(r, shard, id);
+        }
+        for (uint32_t i = 0; i < dir.childCount; ++i) {
+            std::string sub = previous->directoryPath(previous->child(dir, i));
+            pool.submit([this, sub] { scanDir(sub); });
+        }
+        reused[w]++;
+    }
+
+    // dirPath always ends with '/'
+    void scanDir(const std::string& dirPath) {
+        int fd = openat(AT_FDCWD, dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) return;
+
+        struct stat dst;
+        int64_t dirMtime = fstat(fd, &dst) == 0 ? toNs(dst.st_mtim) : 0;
+        FileTable& shard = shards[pool.currentWorker()];
+        FileTable::Id dirId = shard.addDirectory(dirPath, dirMtime);
+        progress.advance();
+
+        // A directory modified within a second of the previous scan may have
+        // changed after it was listed, so only older ones are trusted
+        const ScanIndex::DirRecord* cachedDir = previous ? previous->findDirectory(dirPath) : nullptr;
+        if (cachedDir && cachedDir->mtimeNs == dirMtime && dirMtime < previous->createdNs() - 1000000000) {
+            close(fd);
+            reuseDir(shard, dirId, *cachedDir);
+            return;
+        }
+
+        alignas(8) char buf[32 * 1024];
+        while (true) {
+            long n = syscall(SYS_getdents64, fd, buf, sizeof(buf));
+            if (n <= 0) break;
+
+            for (long off = 0; off < n;) {
+                auto* d = reinterpret_cast<LinuxDirent64*>(buf + off);
+                off += d->d_reclen;
+
+                const char* name = d->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+
+                if (d->d_type == DT_DIR) {
+                    std::string sub = dirPath + name + "/";
+                    pool.submit([this, sub] { scanDir(sub); });
+                    continue;
+                }
+
+                // One stat per entry. Symlinks are followed for files but never
+                // descended into, like recursive_directory_iterator.
+                struct stat st;
+                if (d->d_type == DT_UNKNOWN) {
+                    if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+                    if (S_ISDIR(st.st_mode)) {
+                        std::string sub = dirPath + name + "/";
+                        pool.submit([this, sub] { scanDir(sub); });
+                        continue;
+                    }
+                    if (S_ISLNK(st.st_mode) && fstatat(fd, name, &st, 0) != 0) continue;
+                } else if (d->d_type == DT_REG || d->d_type == DT_LNK) {
+                    if (fstatat(fd, name, &st, 0) != 0) continue;
+                } else {
+                    continue; // sockets, fifos, devices
+                }
+
+                if (S_ISREG(st.st_mode)) addFile(shard, dirId, name, st, cachedDir);
+            }
+        }
+        close(fd);
+    }
+};
+
+} // namespace
+
+ScanResult scanDirectory(const std::string& directory, unsigned threads, const ScanIndex* previous,
+                         const ProgressCallback& progress) {
+    instrument::PhaseTimer timer(instrument::Phase::Scan);
+    ScanResult result;
+    std::error_code ec;
+    result.scannedAtNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (!fs::exists(directory, ec) || ec) {
+        result.error = "Directory doesn't exist: " + directory;
+        return result;
+    }
+
+    std::string root = directory;
+    if (root.empty() || root.back() != '/') root += '/';
+
+    if (previous && !previous->isLoaded()) previous = nullptr;
+    ParallelScan scan(threads, previous, progress);
+    scan.pool.submit([&scan, root] { scan.scanDir(root); });
+    scan.pool.wait();
+
+    // Merge the per-worker shards
+    result.files = FileTable::merge(std::move(scan.shards));
+    if (previous) result.files.setHashNames(previous->fastHashName(), previous->strongHashName());
+    for (size_t r : scan.reused) result.directoriesReused += r;
+    instrument::addFiles(instrument::Phase::Scan, result.files.size());
+
+    fillSpaceInfo(result, directory);
+    return result;
+}
+
+bool statFile(const std::string& path, FileInfo& info) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    size_t slash = path.rfind('/');
+    std::string dirPath = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    time_t now = time(nullptr);
+    info.name = name;
+    info.path = path;
+    info.size = static_cast<uintmax_t>(st.st_size);
+    info.lastModified = st.st_mtime < now ? (now - st.st_mtime) / 86400 : 0;
+    info.type = extensionOf(name);
+    if (info.type.empty()) info.type = "unknown";
+    info.hash.clear();
+    info.strongHash.clear();
+    info.inode = static_cast<uint64_t>(st.st_ino);
+    info.mtimeNs = toNs(st.st_mtim);
+    return true;
+}
+
+#else
+
+// Portable single-threaded fallback built on std::filesystem
+static ScanResult scanDirectorySerial(const std::string& directory, const ProgressCallback& progress) {
     ScanResult result;
     std::error_code ec;
     
@@ -22,13 +242,14 @@ ScanResult scanDirectory(const std::string& directory) {
     result.usedSpace = 0.0;
     result.totalSpace = 0.0;
     result.freeSpace = 0.0;
-    result.files.clear();
     
     if (!fs::exists(directory, ec) || ec) {
-        std::cerr << "Directory doesn't exist: " << directory << std::endl;
+        result.error = "Directory doesn't exist: " + directory;
         return result;
     }
     
+    ProgressReporter reporter(progress, "scan");
+
     // Scan all files
     for (auto it = fs::recursive_directory_iterator(directory, ec); 
          it != fs::recursive_directory_iterator() && !ec; 
@@ -40,6 +261,7 @@ ScanResult scanDirectory(const std::string& directory) {
         }
 
         const auto& entry = *it;
+        if (fs::is_directory(entry, ec)) reporter.advance();
         if (fs::is_regular_file(entry, ec) && !ec) {
             FileInfo info;
             info.path = entry.path().string();
@@ -60,22 +282,38 @@ ScanResult scanDirectory(const std::string& directory) {
             info.type = entry.path().extension().string();
             if (info.type.empty()) info.type = "unknown";
             
-            result.files.push_back(info);
+            result.files.add(info);
         }
     }
 
-    // FIXED: Calculate used space properly
-    result.usedSpace = 0.0;
-    for (const auto& file : result.files) {
-        result.usedSpace += file.size / (1024.0 * 1024.0); // Convert bytes to MB
-    }
-
-    // Get disk space information
-    auto space = fs::space(directory, ec);
-    if (!ec) {
-        result.totalSpace = space.capacity / (1024.0 * 1024.0);
-        result.freeSpace = space.free / (1024.0 * 1024.0);
-    }
+    fillSpaceInfo(result, directory);
+    return result;
+}
 
+ScanResult scanDirectory(const std::string& directory, unsigned, const ScanIndex*,
+                         const ProgressCallback& progress) {
+    instrument::PhaseTimer timer(instrument::Phase::Scan);
+    ScanResult result = scanDirectorySerial(directory, progress);
+    instrument::addFiles(instrument::Phase::Scan, result.files.size());
     return result;
 }
+
+bool statFile(const std::string& path, FileInfo& info) {
+    std::error_code ec;
+    fs::path p(path);
+    if (!fs::is_regular_file(p, ec) || ec) return false;
+
+    info = FileInfo();
+    info.name = p.filename().string();
+    info.path = path;
+    info.size = fs::file_size(p, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(p, ec);
+    info.lastModified = ec ? 0 : formatTime(mtime);
+    info.mtimeNs = ec ? 0 : std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count();
+    info.type = p.extension().string();
+    if (info.type.empty()) info.type = "unknown";
+    return true;
+}
+
+#endif
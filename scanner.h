@@ -3,7 +3,10 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>  // Add this for uintmax_t
+#include "filetable.h"
+#include "progress.h"
 
 struct FileInfo {
     std::string name;
@@ -11,16 +14,44 @@ struct FileInfo {
     uintmax_t size;      // This line needs to be here
     long long lastModified;
     std::string type;
-    std::string hash;
+    std::string hash;        // full-content fast hash, empty until computed
+    std::string strongHash;  // full-content strong hash, empty until computed
+    uint64_t inode = 0;
+    int64_t mtimeNs = 0;
 };
 
+// Headline numbers of a scan, cheap to keep for before/after reports
+struct ScanTotals {
+    size_t files = 0;
+    double totalSpace = 0.0;
+    double freeSpace = 0.0;
+    double usedSpace = 0.0;
+};
+
+// Move-only because the file table is; pass it by reference
 struct ScanResult {
-    std::vector<FileInfo> files;
+    FileTable files;                  // also holds the scanned directories and their mtimes
+    int64_t scannedAtNs = 0;          // wall clock when the scan started
+    size_t directoriesReused = 0;     // taken unchanged from a ScanIndex
     double totalSpace = 0.0;
     double freeSpace = 0.0;
     double usedSpace = 0.0;
+    std::string error;                // why nothing was scanned, "" on success
+
+    ScanTotals totals() const { return {files.size(), totalSpace, freeSpace, usedSpace}; }
 };
 
-ScanResult scanDirectory(const std::string& directory);
+class ScanIndex;
+
+// Walks the tree on a work-stealing thread pool (0 = one thread per core).
+// With a previous index, directories whose mtime is unchanged are taken from
+// it without being listed, and unchanged files keep their cached hashes.
+// progress counts directories in the "scan" phase (total unknown). A missing
+// directory gives an empty result with error set; nothing is printed.
+ScanResult scanDirectory(const std::string& directory, unsigned threads = 0,
+                         const ScanIndex* previous = nullptr, const ProgressCallback& progress = nullptr);
+
+// Fill info for a single path; false unless it is (or links to) a regular file
+bool statFile(const std::string& path, FileInfo& info);
 
 #endif
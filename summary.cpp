@@ -3,19 +3,21 @@
 #include <iostream>
 #include <iomanip>
 
-void Summary::printStep(const std::string& stepName, const ScanResult& before, 
-                       const ScanResult& after, int filesProcessed) {
+void Summary::printStep(const std::string& stepName, const ScanTotals& before, 
+                       const ScanTotals& after, int filesProcessed,
+                       const std::vector<instrument::PhaseStats>& phases) {
     std::cout << "\n=== " << stepName << " Summary ===\n";
     std::cout << "Files processed: " << filesProcessed << "\n";
-    std::cout << "Before: " << before.files.size() << " files, " 
+    std::cout << "Before: " << before.files << " files, " 
               << std::fixed << std::setprecision(2) << before.usedSpace << " MB\n";
-    std::cout << "After:  " << after.files.size() << " files, " 
+    std::cout << "After:  " << after.files << " files, " 
               << std::fixed << std::setprecision(2) << after.usedSpace << " MB\n";
     std::cout << "Space saved: " << (before.usedSpace - after.usedSpace) << " MB\n";
+    printPhases(phases);
 }
 
-void Summary::printFinal(const ScanResult& initial, const ScanResult& final, 
-                        int totalFilesProcessed) {
+void Summary::printFinal(const ScanTotals& initial, const ScanTotals& final, 
+                        int totalFilesProcessed, const std::vector<instrument::PhaseStats>& phases) {
     std::cout << "\n[COMPLETE SUMMARY REPORT]\n";
     std::cout << "=========================================\n";
     std::cout << "======= FINAL SUMMARY =======\n";
@@ -25,4 +27,28 @@ void Summary::printFinal(const ScanResult& initial, const ScanResult& final,
               << final.usedSpace << " MB\n";
     std::cout << "Total Files Processed: " << totalFilesProcessed << "\n";
     std::cout << "============================\n";
+    printPhases(phases);
+}
+
+void Summary::printPhases(const std::vector<instrument::PhaseStats>& phases, std::ostream& out) {
+    bool any = false;
+    for (const auto& p : phases) any = any || p.calls > 0;
+    if (!any) return;
+
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << "\nTime by phase:\n";
+    out << std::left << std::setw(12) << "Phase" << std::right << std::setw(10) << "Files"
+        << std::setw(11) << "Wall s" << std::setw(11) << "CPU s" << std::setw(12) << "Read MB"
+        << std::setw(10) << "MB/s" << "\n";
+    out << std::fixed;
+    for (const auto& p : phases) {
+        if (p.calls == 0) continue;
+        out << std::left << std::setw(12) << p.name << std::right << std::setw(10) << p.files
+            << std::setprecision(3) << std::setw(11) << p.wallSeconds << std::setw(11) << p.cpuSeconds
+            << std::setprecision(2) << std::setw(12) << p.bytes / (1024.0 * 1024.0)
+            << std::setprecision(1) << std::setw(10) << p.mbPerSecond() << "\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
 }
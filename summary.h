@@ -2,20 +2,30 @@
 #define SUMMARY_H
 
 #include <string>
+#include <vector>
+#include <iostream>
 #include "scanner.h"  // So we can use ScanResult
+#include "instrument.h"
 
 class Summary {
 public:
-    // Print a summary after each step automatically
+    // Print a summary after each step automatically, with the time spent in
+    // each phase during the step when phases is given
     static void printStep(const std::string& stepName,
-                          const ScanResult& before,
-                          const ScanResult& after,
-                          int filesAffected);
+                          const ScanTotals& before,
+                          const ScanTotals& after,
+                          int filesAffected,
+                          const std::vector<instrument::PhaseStats>& phases = {});
 
     // Optional: overall summary (start vs end of project)
-    static void printFinal(const ScanResult& start,
-                           const ScanResult& end,
-                           int totalFilesProcessed);
+    static void printFinal(const ScanTotals& start,
+                           const ScanTotals& end,
+                           int totalFilesProcessed,
+                           const std::vector<instrument::PhaseStats>& phases = {});
+
+    // Wall and CPU time, files, bytes read and throughput of every phase
+    // that ran; nothing if none did
+    static void printPhases(const std::vector<instrument::PhaseStats>& phases, std::ostream& out = std::cout);
 };
 
 #endif
@@ -0,0 +1,103 @@
+#include "threadpool.h"
+
+namespace {
+thread_local const ThreadPool* tlsPool = nullptr;
+thread_local int tlsWorker = -1;
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& t : workers) t.join();
+}
+
+int ThreadPool::currentWorker() const {
+    return tlsPool == this ? tlsWorker : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int self = currentWorker();
+    unsigned target = self >= 0 ? static_cast<unsigned>(self)
+                                : nextQueue.fetch_add(1, std::memory_order_relaxed) % size();
+    // Count the task before publishing it: once it is in a deque any worker
+    // may run it, and its completion must not bring pending (or queued)
+    // below the tasks still out there
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued++;
+        pending++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    workAvailable.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return pending == 0; });
+}
+
+bool ThreadPool::tryPop(unsigned self, std::function<void()>& task) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned i = 1; i < size(); ++i) {
+        Queue& victim = *queues[(self + i) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned self) {
+    tlsPool = this;
+    tlsWorker = static_cast<int>(self);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            workAvailable.wait(lock, [this] { return stopping || queued > 0; });
+            if (stopping && queued == 0) return;
+        }
+
+        std::function<void()> task;
+        if (!tryPop(self, task)) continue; // another worker got there first
+
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            queued--;
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (--pending == 0) allDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Each worker owns a deque: tasks submitted from a
+// worker go to the back of its own deque and are popped LIFO, idle workers
+// steal from the front of the others. wait() blocks until every task,
+// including the ones spawned by running tasks, has finished. Tasks must not
+// throw.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0); // 0 = one per hardware thread
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    void wait();
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // Index of the calling worker in this pool, or -1 from any other thread
+    int currentWorker() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex stateMutex;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+    size_t queued = 0;   // tasks sitting in a deque
+    size_t pending = 0;  // tasks queued or running
+    bool stopping = false;
+    std::atomic<unsigned> nextQueue{0};
+
+    bool tryPop(unsigned self, std::function<void()>& task);
+    void workerLoop(unsigned self);
+};
+
+#endif
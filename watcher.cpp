@@ -0,0 +1,285 @@
+#include "watcher.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+LiveIndex::LiveIndex(const std::string& directory, const DuplicateOptions& options)
+    : root(directory), options(options) {
+    if (root.empty() || root.back() != '/') root += '/';
+}
+
+LiveIndex::~LiveIndex() {
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+}
+
+#ifdef __linux__
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+
+}
+
+bool LiveIndex::start() {
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) return false;
+    rescanAll();
+    return true;
+}
+
+size_t LiveIndex::poll(int timeoutMs, int quietMs, int maxBatchMs) {
+    std::unordered_set<std::string> touched;
+    std::vector<std::string> newDirs, goneDirs;
+    bool overflow = false;
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int wait = timeoutMs;
+    alignas(struct inotify_event) char buf[64 * 1024];
+
+    // Keep draining until nothing arrives for quietMs, or until the batch is
+    // maxBatchMs old
+    std::chrono::steady_clock::time_point deadline;
+    bool started = false;
+    while (::poll(&pfd, 1, wait) > 0) {
+        if (!started) {
+            deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(maxBatchMs);
+            started = true;
+        }
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            for (ssize_t off = 0; off < n;) {
+                auto* ev = reinterpret_cast<struct inotify_event*>(buf + off);
+                off += sizeof(struct inotify_event) + ev->len;
+
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                auto it = watches.find(ev->wd);
+                if (it == watches.end()) continue;
+
+                if (ev->mask & IN_IGNORED) {
+                    watchByPath.erase(it->second);
+                    watches.erase(it);
+                    continue;
+                }
+                if (ev->len == 0) continue; // events on the directory itself
+
+                std::string path = it->second + ev->name;
+                if (ev->mask & IN_ISDIR) {
+                    if (ev->mask & (IN_CREATE | IN_MOVED_TO)) newDirs.push_back(path + "/");
+                    if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) goneDirs.push_back(path + "/");
+                } else {
+                    touched.insert(path);
+                }
+            }
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) break;
+        wait = std::min<int>(quietMs, static_cast<int>(left.count()));
+    }
+
+    if (overflow) {
+        // Events were lost; only a full rescan is trustworthy
+        rescanAll();
+        return files.size();
+    }
+
+    for (const auto& dir : goneDirs) removeTree(dir);
+    for (const auto& dir : newDirs) addTree(dir);
+    for (const auto& path : touched) updateFile(path);
+    regroup();
+    return touched.size() + goneDirs.size() + newDirs.size();
+}
+
+void LiveIndex::addTree(const std::string& dirPath, bool recheck) {
+    ScanResult sub = scanDirectory(dirPath);
+    for (auto f : sub.files) putFile(f.info());
+
+    // Directories that changed between being listed and being watched are
+    // listed once more; anything later arrives as events
+    std::vector<std::string> changed;
+    for (FileTable::Id d = 0; d < sub.files.directoryCount(); ++d) {
+        std::string path = sub.files.directoryPath(d);
+        int wd = inotify_add_watch(fd, path.c_str(), WATCH_MASK);
+        if (wd < 0) continue;
+        watches[wd] = path;
+        watchByPath[path] = wd;
+
+        struct stat st;
+        if (recheck && stat(path.c_str(), &st) == 0 &&
+            int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec != sub.files.directoryMtime(d)) {
+            changed.push_back(path);
+        }
+    }
+    for (const auto& path : changed) addTree(path, false);
+}
+
+void LiveIndex::removeTree(const std::string& dirPath) {
+    for (auto it = watchByPath.begin(); it != watchByPath.end();) {
+        if (it->first.compare(0, dirPath.size(), dirPath) == 0) {
+            inotify_rm_watch(fd, it->second);
+            watches.erase(it->second);
+            it = watchByPath.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<std::string> gone;
+    for (const auto& pair : files) {
+        if (pair.first.compare(0, dirPath.size(), dirPath) == 0) gone.push_back(pair.first);
+    }
+    for (const auto& path : gone) eraseFile(path);
+}
+
+#else
+
+bool LiveIndex::start() {
+    return false;
+}
+
+size_t LiveIndex::poll(int, int) {
+    return 0;
+}
+
+void LiveIndex::addTree(const std::string&, bool) {}
+
+void LiveIndex::removeTree(const std::string&) {}
+
+#endif
+
+void LiveIndex::rescanAll() {
+#ifdef __linux__
+    for (const auto& pair : watches) inotify_rm_watch(fd, pair.first);
+#endif
+    watches.clear();
+    watchByPath.clear();
+    files.clear();
+    bySize.clear();
+    groupsBySize.clear();
+    dirtySizes.clear();
+
+    addTree(root);
+    regroup();
+}
+
+void LiveIndex::updateFile(const std::string& path) {
+    FileInfo info;
+    if (statFile(path, info)) {
+        putFile(std::move(info));
+    } else {
+        eraseFile(path);
+    }
+}
+
+void LiveIndex::putFile(FileInfo info) {
+    auto it = files.find(info.path);
+    if (it != files.end()) {
+        const FileInfo& old = it->second;
+        if (old.size == info.size && old.mtimeNs == info.mtimeNs && old.inode == info.inode) {
+            return; // metadata only, hashes still valid
+        }
+        eraseFile(info.path);
+    }
+    bySize[info.size].insert(info.path);
+    dirtySizes.insert(info.size);
+    files.emplace(info.path, std::move(info));
+}
+
+void LiveIndex::eraseFile(const std::string& path) {
+    auto it = files.find(path);
+    if (it == files.end()) return;
+
+    uintmax_t size = it->second.size;
+    auto bucket = bySize.find(size);
+    if (bucket != bySize.end()) {
+        bucket->second.erase(path);
+        if (bucket->second.empty()) bySize.erase(bucket);
+    }
+    dirtySizes.insert(size);
+    files.erase(it);
+}
+
+void LiveIndex::regroup() {
+    for (uintmax_t size : dirtySizes) {
+        groupsBySize.erase(size);
+        auto bucket = bySize.find(size);
+        if (bucket == bySize.end() || bucket->second.size() < 2) continue;
+
+        // Stored hashes all come from earlier runs with the same options
+        FileTable candidates;
+        candidates.setHashNames(options.fastHash, options.strongHash);
+        for (const auto& path : bucket->second) candidates.add(files.at(path));
+
+        auto groups = findDuplicates(candidates, nullptr, options);
+
+        // Keep the hashes so the next change in this bucket only hashes the newcomer
+        for (auto f : candidates) {
+            FileInfo& stored = files.at(f.path());
+            stored.hash = f.hash();
+            stored.strongHash = f.strongHash();
+        }
+
+        auto& result = groupsBySize[size];
+        for (const auto& pair : groups) {
+            std::vector<std::string> paths;
+            for (FileTable::Id id : pair.second) paths.push_back(candidates.path(id));
+            result.push_back(std::move(paths));
+        }
+    }
+    dirtySizes.clear();
+}
+
+ScanResult LiveIndex::snapshot() const {
+    ScanResult result;
+
+    // Parents before children so directories link up
+    std::vector<std::string> dirs;
+    for (const auto& pair : watchByPath) dirs.push_back(pair.first);
+    std::sort(dirs.begin(), dirs.end());
+    for (const auto& dir : dirs) result.files.addDirectory(dir);
+
+    result.files.setHashNames(options.fastHash, options.strongHash);
+    result.files.reserve(files.size());
+    for (const auto& pair : files) {
+        result.files.add(pair.second);
+        result.usedSpace += pair.second.size / (1024.0 * 1024.0);
+    }
+
+    std::error_code ec;
+    auto space = fs::space(root, ec);
+    if (!ec) {
+        result.totalSpace = space.capacity / (1024.0 * 1024.0);
+        result.freeSpace = space.free / (1024.0 * 1024.0);
+    }
+    return result;
+}
+
+std::vector<std::vector<std::string>> LiveIndex::duplicateGroups() const {
+    std::vector<std::vector<std::string>> all;
+    for (const auto& pair : groupsBySize) {
+        all.insert(all.end(), pair.second.begin(), pair.second.end());
+    }
+    return all;
+}
+
+uintmax_t LiveIndex::reclaimableBytes() const {
+    uintmax_t bytes = 0;
+    for (const auto& pair : groupsBySize) {
+        for (const auto& group : pair.second) bytes += pair.first * (group.size() - 1);
+    }
+    return bytes;
+}
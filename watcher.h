@@ -0,0 +1,66 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "scanner.h"
+#include "duplicates.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Keeps the file table and duplicate groups of a tree current from inotify
+// events instead of periodic full scans. Events are drained in batches; each
+// batch re-stats only the touched paths, rescans only new or moved-in
+// directories, and regroups only the size buckets whose members changed.
+// Linux only; start() fails elsewhere.
+class LiveIndex {
+public:
+    LiveIndex(const std::string& directory, const DuplicateOptions& options = DuplicateOptions());
+    ~LiveIndex();
+
+    LiveIndex(const LiveIndex&) = delete;
+    LiveIndex& operator=(const LiveIndex&) = delete;
+
+    // Initial scan and watch setup; false if inotify is unavailable
+    bool start();
+
+    // Wait up to timeoutMs for events, keep collecting until the tree has
+    // been quiet for quietMs, then apply the batch. A tree that never goes
+    // quiet (a growing log) still gets its batch applied maxBatchMs after the
+    // first event; later events wait for the next call. Returns the number of
+    // paths that changed.
+    size_t poll(int timeoutMs, int quietMs = 200, int maxBatchMs = 1000);
+
+    ScanResult snapshot() const;
+    size_t fileCount() const { return files.size(); }
+    size_t directoryCount() const { return watches.size(); }
+
+    // Groups of identical files (paths), and the bytes deleting all but one
+    // copy of each would free
+    std::vector<std::vector<std::string>> duplicateGroups() const;
+    uintmax_t reclaimableBytes() const;
+
+private:
+    std::string root;
+    DuplicateOptions options;
+    int fd = -1;
+
+    std::unordered_map<int, std::string> watches;       // watch descriptor -> dir path ('/'-terminated)
+    std::unordered_map<std::string, int> watchByPath;
+    std::unordered_map<std::string, FileInfo> files;    // by path
+    std::unordered_map<uintmax_t, std::unordered_set<std::string>> bySize;
+    std::unordered_map<uintmax_t, std::vector<std::vector<std::string>>> groupsBySize;
+    std::unordered_set<uintmax_t> dirtySizes;
+
+    void addTree(const std::string& dirPath, bool recheck = true);
+    void removeTree(const std::string& dirPath);
+    void updateFile(const std::string& path);
+    void putFile(FileInfo info);
+    void eraseFile(const std::string& path);
+    void regroup();
+    void rescanAll();
+};
+
+#endif